@@ -0,0 +1,410 @@
+#include "archive.hpp"
+#include "config.hpp"
+#include "path.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace ftp;
+
+// tar 的块大小
+static constexpr size_t BLOCK = 512;
+// 整个读入内存的文件大小上限，更大的文件发送时直接读取
+static constexpr size_t SMALL_FILE = 1024 * 1024;
+// 预读最多领先发送进度的项数与内存字节数
+static constexpr size_t WINDOW = 256;
+static constexpr size_t AHEAD_LIMIT = 32 * 1024 * 1024;
+// 大文件打开后提示内核预读的长度
+static constexpr size_t LARGE_PREFETCH = 8 * 1024 * 1024;
+
+// 归档中的一项
+struct Archive::Entry {
+  std::string name;         // 归档内路径，目录以 / 结尾
+  bool dir;                 // 是否为目录
+  uint64_t size;            // 遍历时的文件大小
+  time_t mtime;             // 修改时间
+  uint64_t offset = 0;      // 头部在归档中的偏移
+  uint32_t header_size = 0; // 头部长度（含长文件名块）
+};
+
+// 一项的预读结果
+struct Archive::Slot {
+  bool ready = false;             // 已可发送
+  std::string data;               // 小文件的内容
+  std::unique_ptr<ReadFile> file; // 大文件，发送时直接读取
+};
+
+static uint64_t round_up(uint64_t size) {
+  return (size + BLOCK - 1) / BLOCK * BLOCK;
+}
+
+// 以八进制写入定长字段，width 含结尾的 NUL
+static void put_octal(char *field, size_t width, uint64_t value) {
+  field[width - 1] = '\0';
+  for (size_t i = width - 1; i-- > 0;) {
+    field[i] = static_cast<char>('0' + (value & 7));
+    value >>= 3;
+  }
+}
+
+// 大小字段，8 GiB 以上使用 GNU 的 base-256 编码
+static void put_size(char *field, uint64_t value) {
+  if (value < (1ULL << 33)) {
+    put_octal(field, 12, value);
+    return;
+  }
+  field[0] = static_cast<char>(0x80);
+  for (int i = 11; i > 0; i--) {
+    field[i] = static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+}
+
+// 按 ustar 拆分路径：prefix 最多 155 字节，name 最多 100 字节
+static bool split_name(std::string_view path, std::string_view &prefix,
+                       std::string_view &name) {
+  if (path.size() <= 100) {
+    prefix = {};
+    name = path;
+    return true;
+  }
+  // 目录名末尾的 / 不作为拆分点
+  size_t slash =
+      path.find('/', path.size() > 101 ? path.size() - 101 : 0);
+  if (slash == std::string_view::npos || slash == 0 || slash > 155 ||
+      slash + 1 >= path.size()) {
+    return false;
+  }
+  prefix = path.substr(0, slash);
+  name = path.substr(slash + 1);
+  return true;
+}
+
+static void fill_header(char *block, std::string_view name,
+                        std::string_view prefix, char type, uint64_t size,
+                        time_t mtime, uint32_t mode) {
+  std::memset(block, 0, BLOCK);
+  std::memcpy(block, name.data(), std::min<size_t>(name.size(), 100));
+  put_octal(block + 100, 8, mode);
+  put_octal(block + 108, 8, 0);
+  put_octal(block + 116, 8, 0);
+  put_size(block + 124, size);
+  put_octal(block + 136, 12, mtime < 0 ? 0 : mtime);
+  block[156] = type;
+  std::memcpy(block + 257, "ustar", 6);
+  std::memcpy(block + 263, "00", 2);
+  std::memcpy(block + 265, "user", 4);
+  std::memcpy(block + 297, "group", 5);
+  std::memcpy(block + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+  // 校验和按校验和字段为空格计算
+  std::memset(block + 148, ' ', 8);
+  uint32_t sum = 0;
+  for (size_t i = 0; i < BLOCK; i++) {
+    sum += static_cast<unsigned char>(block[i]);
+  }
+  put_octal(block + 148, 7, sum);
+  block[155] = ' ';
+}
+
+Task<std::unique_ptr<Archive>> Archive::open(const Client &session,
+                                             std::string_view path) {
+  int fd = Path::open(session, path, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    co_return nullptr;
+  }
+  std::pmr::string target(session.arena);
+  Path::normalize(session.curr_path, path, target);
+  // 归档内的路径以目录名开头，解开后得到同名目录；根目录不加前缀
+  std::string_view name = target;
+  name.remove_prefix(name.rfind('/') + 1);
+  auto archive = std::make_unique<Archive>(
+      fd, name.empty() ? "" : std::string(name) + "/");
+  // 遍历整棵目录树可能很慢，放到磁盘线程中进行
+  co_await Executor::blocking([&archive, fd, named = !name.empty()] {
+    struct stat dir_stat;
+    if (named && fstat(fd, &dir_stat) == 0) {
+      archive->entries.push_back(
+          {archive->prefix, true, 0, dir_stat.st_mtime});
+    }
+    int walk_fd = dup(fd);
+    if (walk_fd >= 0) {
+      archive->collect(walk_fd, "");
+    }
+    archive->layout();
+    return 0;
+  });
+  int threads = Config::get()->archive_threads;
+  for (int i = 0; i < threads; i++) {
+    archive->workers.emplace_back(&Archive::prefetch, archive.get());
+  }
+  std::cout << "Archive " << target << ": " << archive->entries.size()
+            << " entries, " << archive->size_ << " bytes" << std::endl;
+  co_return archive;
+}
+
+Archive::Archive(int dir_fd, std::string prefix)
+    : ReadFile(-1, 0), dir_fd(dir_fd), prefix(std::move(prefix)) {}
+
+Archive::~Archive() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  close(dir_fd);
+}
+
+void Archive::collect(int fd, const std::string &path) {
+  DIR *dir = fdopendir(fd);
+  if (dir == nullptr) {
+    close(fd);
+    return;
+  }
+  std::vector<std::string> names;
+  while (dirent *entry = readdir(dir)) {
+    std::string_view name = entry->d_name;
+    if (name != "." && name != "..") {
+      names.emplace_back(name);
+    }
+  }
+  std::sort(names.begin(), names.end());
+  auto storage = Storage::get();
+  for (auto &name : names) {
+    struct stat status;
+    if (storage->stat_at(dirfd(dir), name.c_str(), status) < 0) {
+      continue;
+    }
+    if (S_ISREG(status.st_mode)) {
+      entries.push_back({prefix + path + name, false,
+                         static_cast<uint64_t>(status.st_size),
+                         status.st_mtime});
+    } else if (S_ISDIR(status.st_mode)) {
+      // 不跟随符号链接，与路径层一样不会越出根目录
+      int child = openat(dirfd(dir), name.c_str(),
+                         O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (child < 0) {
+        continue;
+      }
+      entries.push_back({prefix + path + name + "/", true, 0,
+                         status.st_mtime});
+      collect(child, path + name + "/");
+    }
+    // 符号链接与特殊文件不打包
+  }
+  closedir(dir);
+}
+
+void Archive::layout() {
+  uint64_t offset = 0;
+  for (auto &entry : entries) {
+    std::string_view prefix_part;
+    std::string_view name_part;
+    entry.offset = offset;
+    entry.header_size = BLOCK;
+    if (!split_name(entry.name, prefix_part, name_part)) {
+      // GNU 长文件名：一个头部加上存放完整路径的数据块
+      entry.header_size += BLOCK + round_up(entry.name.size() + 1);
+    }
+    offset += entry.header_size + round_up(entry.size);
+  }
+  // 归档以两个全零块结束
+  size_ = offset + 2 * BLOCK;
+  slots = std::vector<Slot>(entries.size());
+}
+
+std::string Archive::header(const Entry &entry) const {
+  std::string out(entry.header_size, '\0');
+  char *block = out.data();
+  std::string_view prefix_part;
+  std::string_view name_part;
+  if (!split_name(entry.name, prefix_part, name_part)) {
+    fill_header(block, "././@LongLink", {}, 'L', entry.name.size() + 1, 0,
+                0644);
+    std::memcpy(block + BLOCK, entry.name.data(), entry.name.size());
+    block += BLOCK + round_up(entry.name.size() + 1);
+    prefix_part = {};
+    name_part = std::string_view(entry.name).substr(0, 100);
+  }
+  fill_header(block, name_part, prefix_part, entry.dir ? '5' : '0',
+              entry.size, entry.mtime, entry.dir ? 0755 : 0644);
+  return out;
+}
+
+void Archive::prefetch() {
+  while (true) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] {
+        return stopping || next_load >= entries.size() ||
+               (next_load < consumed + WINDOW && ahead_bytes < AHEAD_LIMIT);
+      });
+      if (stopping || next_load >= entries.size()) {
+        return;
+      }
+      index = next_load++;
+    }
+    load(index);
+    Executor::Loop *wake_loop = nullptr;
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      slots[index].ready = true;
+      ahead_bytes += slots[index].data.size();
+      if (waiting == index) {
+        wake_loop = loop;
+        handle = std::exchange(waiter, {});
+        waiting = SIZE_MAX;
+      }
+    }
+    if (handle) {
+      Executor::resume_on(wake_loop, handle);
+    }
+  }
+}
+
+void Archive::load(size_t index) {
+  const Entry &entry = entries[index];
+  Slot &slot = slots[index];
+  if (entry.dir) {
+    return;
+  }
+  // 经由存储后端读取，去重存储中的清单会还原为文件内容
+  auto file = Storage::get()->open_read_beneath(
+      dir_fd, entry.name.c_str() + prefix.size());
+  if (file == nullptr) {
+    // 遍历之后被删除，内容补零，归档结构保持完整
+    std::cerr << "Failed to open " << entry.name << ": " << strerror(errno)
+              << std::endl;
+    return;
+  }
+  if (entry.size > SMALL_FILE) {
+    if (file->fd() >= 0) {
+      posix_fadvise(file->fd(), 0, LARGE_PREFETCH, POSIX_FADV_WILLNEED);
+    }
+    slot.file = std::move(file);
+    return;
+  }
+  slot.data.resize(entry.size);
+  size_t total = 0;
+  while (total < entry.size) {
+    ssize_t n = file->read(slot.data.data() + total, entry.size - total, total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    total += n;
+  }
+  slot.data.resize(total);
+}
+
+void Archive::consume(size_t index) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (index <= consumed) {
+    return;
+  }
+  for (size_t i = consumed; i < index && i < slots.size(); i++) {
+    ahead_bytes -= slots[i].data.size();
+    slots[i].data = std::string();
+    slots[i].file.reset();
+  }
+  consumed = index;
+  cv.notify_all();
+}
+
+size_t Archive::find(uint64_t offset) const {
+  if (offset >= size_ - 2 * BLOCK) {
+    return entries.size();
+  }
+  auto it = std::upper_bound(entries.begin(), entries.end(), offset,
+                             [](uint64_t value, const Entry &entry) {
+                               return value < entry.offset;
+                             });
+  return it - entries.begin() - 1;
+}
+
+Task<ssize_t> Archive::readable(size_t offset) {
+  uint64_t trailer = size_ - 2 * BLOCK;
+  size_t index = find(offset);
+  consume(index);
+  if (index >= entries.size()) {
+    co_return size_;
+  }
+  struct Awaiter {
+    Archive *self;
+    size_t index;
+    bool await_ready() {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      return self->slots[index].ready;
+    }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      if (self->slots[index].ready) {
+        return false;
+      }
+      self->waiting = index;
+      self->loop = Executor::current();
+      self->waiter = handle;
+      return true;
+    }
+    void await_resume() {}
+  };
+  co_await Awaiter{this, index};
+  co_return index + 1 < entries.size() ? entries[index + 1].offset : trailer;
+}
+
+ssize_t Archive::read(char *data, size_t size, size_t offset) {
+  uint64_t trailer = size_ - 2 * BLOCK;
+  size_t index = find(offset);
+  if (index >= entries.size()) {
+    size = std::min<size_t>(size, size_ - offset);
+    std::memset(data, 0, size);
+    return size;
+  }
+  const Entry &entry = entries[index];
+  uint64_t end =
+      index + 1 < entries.size() ? entries[index + 1].offset : trailer;
+  size = std::min<size_t>(size, end - offset);
+  size_t pos = offset - entry.offset;
+  size_t total = 0;
+  if (pos < entry.header_size) {
+    if (cached_index != index) {
+      header_cache = header(entry);
+      cached_index = index;
+    }
+    size_t n = std::min<size_t>(size, entry.header_size - pos);
+    std::memcpy(data, header_cache.data() + pos, n);
+    total += n;
+    pos += n;
+  }
+  if (total < size && pos < entry.header_size + entry.size) {
+    Slot &slot = slots[index];
+    size_t data_pos = pos - entry.header_size;
+    size_t n = std::min<size_t>(size - total, entry.size - data_pos);
+    size_t got = 0;
+    if (slot.file != nullptr) {
+      ssize_t bytes = slot.file->read(data + total, n, data_pos);
+      got = bytes < 0 ? 0 : bytes;
+    } else if (slot.data.size() > data_pos) {
+      got = std::min(n, slot.data.size() - data_pos);
+      std::memcpy(data + total, slot.data.data() + data_pos, got);
+    }
+    // 文件在遍历后变短或读取失败时补零
+    std::memset(data + total + got, 0, n - got);
+    total += n;
+  }
+  // 补齐到块边界
+  std::memset(data + total, 0, size - total);
+  return size;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "define.hpp"
+#include "executor.hpp"
+#include "storage.hpp"
+#include "task.hpp"
+#include <condition_variable>
+#include <coroutine>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace ftp {
+
+// 目录的 tar 归档流（ustar，超长路径使用 GNU 长文件名）
+// RETR <目录>.tar 且不存在同名文件时按需生成，不写临时文件：
+// 先在磁盘线程中遍历目录得到各文件的大小，归档总长度因此可以预先算出；
+// 文件内容由后台线程按归档顺序并行提前读入，发送到某个文件时若尚未
+// 读完则挂起协程等待，不阻塞事件循环
+class Archive : public ReadFile {
+public:
+  // 打开 path 对应的目录并遍历，失败返回 nullptr 并设置 errno
+  static Task<std::unique_ptr<Archive>> open(const Client &session,
+                                             std::string_view path);
+
+  Archive(int dir_fd, std::string prefix);
+  // 停止并等待预读线程
+  ~Archive() override;
+
+  Task<ssize_t> readable(size_t offset) override;
+  ssize_t read(char *data, size_t size, size_t offset) override;
+
+private:
+  struct Entry;
+  struct Slot;
+
+  // 递归收集 fd 下的目录与普通文件，同一目录按名称排序
+  void collect(int fd, const std::string &path);
+  // 计算各项在归档中的偏移与总长度
+  void layout();
+  // 包含 offset 的项，结束块返回 entries.size()
+  size_t find(uint64_t offset) const;
+  // 生成一项的头部（含长文件名块）
+  std::string header(const Entry &entry) const;
+  // 预读线程
+  void prefetch();
+  // 读入一个文件，小文件读到内存，大文件保持打开
+  void load(size_t index);
+  // 已发送到 index 项，释放之前各项占用的内存
+  void consume(size_t index);
+
+private:
+  int dir_fd;                       // 被打包的目录
+  std::string prefix;               // 归档内各路径的前缀（目录名/）
+  std::vector<Entry> entries;       // 按归档顺序排列的各项
+  std::vector<Slot> slots;          // 各项的预读结果
+  std::vector<std::thread> workers; // 预读线程
+  std::mutex mutex;                 // 保护以下预读状态
+  std::condition_variable cv;
+  size_t next_load = 0;    // 下一个待预读的项
+  size_t consumed = 0;     // 正在发送的项
+  size_t ahead_bytes = 0;  // 已读入内存尚未发送的字节数
+  bool stopping = false;   // 析构时通知预读线程退出
+  size_t waiting = SIZE_MAX; // 发送协程等待的项
+  Executor::Loop *loop = nullptr;       // 等待中的协程所在的事件循环
+  std::coroutine_handle<> waiter;       // 等待中的协程
+  size_t cached_index = SIZE_MAX;       // header_cache 对应的项
+  std::string header_cache;             // 最近生成的头部
+};
+
+} // namespace ftp
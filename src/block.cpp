@@ -0,0 +1,43 @@
+#include "block.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace ftp;
+
+void Block::header(char *out, unsigned char descriptor, size_t size) {
+  out[0] = static_cast<char>(descriptor);
+  out[1] = static_cast<char>(size >> 8);
+  out[2] = static_cast<char>(size & 0xff);
+}
+
+ssize_t BlockReader::decode(char *data, size_t size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < size && !finished) {
+    if (header_size < Block::HEADER_SIZE) {
+      header[header_size++] = static_cast<unsigned char>(data[in++]);
+      if (header_size < Block::HEADER_SIZE) {
+        continue;
+      }
+      descriptor = header[0];
+      remaining = header[1] << 8 | header[2];
+    } else {
+      size_t n = std::min(remaining, size - in);
+      // 重启标记只对发送方有意义，不写入文件
+      if (!(descriptor & Block::RESTART)) {
+        std::memmove(data + out, data + in, n);
+        out += n;
+      }
+      in += n;
+      remaining -= n;
+    }
+    if (remaining == 0) {
+      header_size = 0;
+      finished = descriptor & Block::END;
+    }
+  }
+  if (in < size) {
+    return -1;
+  }
+  return out;
+}
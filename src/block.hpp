@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <sys/types.h>
+
+namespace ftp {
+
+// MODE B（RFC 959 块模式）的帧格式
+// 每块由 3 字节块头（描述符、网络字节序的长度）与数据组成，文件以带 EOF
+// 描述符的块结束，数据连接因此可以在多次传输之间保持打开
+class Block {
+public:
+  static constexpr unsigned char END = 64;     // 文件结束（EOF）
+  static constexpr unsigned char ERRORS = 32;  // 数据可能有误
+  static constexpr unsigned char RESTART = 16; // 数据为重启标记
+  static constexpr size_t HEADER_SIZE = 3;     // 块头长度
+  static constexpr size_t MAX_SIZE = 65535;    // 一块最多的数据字节数
+  // 下载时插入重启标记的间隔，标记内容为文件偏移的十进制文本
+  static constexpr size_t MARKER_INTERVAL = 4 * 1024 * 1024;
+
+  // 在 out 处写入块头
+  static void header(char *out, unsigned char descriptor, size_t size);
+
+private:
+  Block() = default;
+  ~Block() = default;
+  Block(const Block &) = delete;
+  Block(Block &&) = delete;
+  Block &operator=(const Block &) = delete;
+  Block &operator=(Block &&) = delete;
+};
+
+// 块模式的接收端，在原缓冲区中去掉块头与重启标记，只留下文件内容
+// 每次传输使用一个新的实例
+class BlockReader {
+public:
+  // 解析刚收到的 size 字节，文件内容移到 data 开头并返回其长度
+  // EOF 块之后仍有数据时返回 -1
+  ssize_t decode(char *data, size_t size);
+  // 是否已收到 EOF 块
+  bool done() const { return finished; }
+
+private:
+  unsigned char header[Block::HEADER_SIZE]; // 正在接收的块头
+  size_t header_size = 0;                   // 块头已接收的字节数
+  unsigned char descriptor = 0;             // 当前块的描述符
+  size_t remaining = 0;                     // 当前块尚未接收的数据
+  bool finished = false;                    // 已收到 EOF 块
+};
+
+} // namespace ftp
@@ -0,0 +1,104 @@
+#include "buffer.hpp"
+#include "config.hpp"
+#include <bit>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+
+using namespace ftp;
+
+inline std::array<BufferPool::FreeNode *,
+                  BufferPool::MAX_SHIFT - BufferPool::MIN_SHIFT + 1>
+    BufferPool::free_lists = {};
+// 空闲链表中缓存的总字节数
+inline size_t BufferPool::cached_bytes = 0;
+// 保护 free_lists 与 cached_bytes 的互斥锁
+inline std::mutex BufferPool::pool_mutex;
+
+Buffer::~Buffer() {
+  if (data_ != nullptr) {
+    BufferPool::release(data_, capacity_);
+  }
+}
+
+Buffer::Buffer(Buffer &&other) noexcept
+    : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.capacity_ = 0;
+}
+
+Buffer &Buffer::operator=(Buffer &&other) noexcept {
+  if (this != &other) {
+    if (data_ != nullptr) {
+      BufferPool::release(data_, capacity_);
+    }
+    data_ = other.data_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+  return *this;
+}
+
+Buffer BufferPool::acquire(size_t size) {
+  size_t capacity = std::bit_ceil(std::max(size, size_t(1) << MIN_SHIFT));
+  size_t shift = std::countr_zero(capacity);
+  if (shift > MAX_SHIFT) {
+    throw std::bad_alloc();
+  }
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    FreeNode *node = free_lists[shift - MIN_SHIFT];
+    if (node != nullptr) {
+      free_lists[shift - MIN_SHIFT] = node->next;
+      cached_bytes -= capacity;
+      return Buffer(reinterpret_cast<char *>(node), size, capacity);
+    }
+  }
+  return Buffer(allocate(capacity), size, capacity);
+}
+
+void BufferPool::release(char *data, size_t capacity) {
+  // 超出缓存上限的缓冲区直接归还系统
+  size_t limit = Config::get()->buffer_pool_size;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (cached_bytes + capacity <= limit) {
+      size_t shift = std::countr_zero(capacity);
+      auto node = reinterpret_cast<FreeNode *>(data);
+      node->next = free_lists[shift - MIN_SHIFT];
+      free_lists[shift - MIN_SHIFT] = node;
+      cached_bytes += capacity;
+      return;
+    }
+  }
+  deallocate(data, capacity);
+}
+
+char *BufferPool::allocate(size_t capacity) {
+  void *data = MAP_FAILED;
+  // 大缓冲区优先使用大页，失败时退回普通页并建议内核合并透明大页
+  if (capacity >= HUGE_PAGE_SIZE) {
+    data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (data == MAP_FAILED) {
+    data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      std::cerr << "Failed to allocate transfer buffer" << std::endl;
+      throw std::bad_alloc();
+    }
+    if (capacity >= HUGE_PAGE_SIZE) {
+      madvise(data, capacity, MADV_HUGEPAGE);
+    }
+  }
+  return static_cast<char *>(data);
+}
+
+void BufferPool::deallocate(char *data, size_t capacity) {
+  munmap(data, capacity);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <mutex>
+
+namespace ftp {
+
+// 从 BufferPool 借出的缓冲区，析构时自动归还
+class Buffer {
+public:
+  Buffer() = default;
+  ~Buffer();
+  Buffer(Buffer &&other) noexcept;
+  Buffer &operator=(Buffer &&other) noexcept;
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
+  char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  friend class BufferPool;
+  Buffer(char *data, size_t size, size_t capacity)
+      : data_(data), size_(size), capacity_(capacity) {}
+
+  char *data_ = nullptr; // 缓冲区首地址，按页对齐
+  size_t size_ = 0;      // 申请的大小
+  size_t capacity_ = 0;  // 实际分配的大小，为 2 的幂
+};
+
+// 全局传输缓冲池
+// 按 2 的幂划分大小等级，空闲缓冲区以侵入式链表缓存，借还不产生堆分配
+class BufferPool {
+public:
+  static Buffer acquire(size_t size);
+
+private:
+  BufferPool() = default;
+  ~BufferPool() = default;
+  BufferPool(const BufferPool &) = delete;
+  BufferPool(BufferPool &&) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+  BufferPool &operator=(BufferPool &&) = delete;
+
+  friend class Buffer;
+  static void release(char *data, size_t capacity);
+  static char *allocate(size_t capacity);
+  static void deallocate(char *data, size_t capacity);
+
+  // 空闲缓冲区链表节点，存放在缓冲区头部
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  static constexpr size_t MIN_SHIFT = 12; // 最小 4KiB
+  static constexpr size_t MAX_SHIFT = 30; // 最大 1GiB
+  static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+private:
+  // 各大小等级的空闲链表
+  static std::array<FreeNode *, MAX_SHIFT - MIN_SHIFT + 1> free_lists;
+  // 空闲链表中缓存的总字节数
+  static size_t cached_bytes;
+  // 保护 free_lists 与 cached_bytes 的互斥锁
+  static std::mutex pool_mutex;
+};
+
+} // namespace ftp
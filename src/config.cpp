@@ -0,0 +1,245 @@
+#include "config.hpp"
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace ftp;
+
+inline std::atomic<std::shared_ptr<const ConfigSnapshot>> Config::current =
+    std::make_shared<const ConfigSnapshot>();
+// 配置文件路径
+inline std::string Config::config_path;
+// 重载成功后的回调
+inline std::vector<std::function<void()>> Config::reload_callbacks;
+
+// 去除首尾空白
+static std::string trim(const std::string &str) {
+  auto begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  auto end = str.find_last_not_of(" \t\r\n");
+  return str.substr(begin, end - begin + 1);
+}
+
+static bool parse_int(const std::string &value, int &out) {
+  try {
+    size_t pos = 0;
+    int res = std::stoi(value, &pos);
+    if (pos != value.size() || res < 0) {
+      return false;
+    }
+    out = res;
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+static bool parse_bool(const std::string &value, bool &out) {
+  if (value == "true" || value == "yes" || value == "1") {
+    out = true;
+  } else if (value == "false" || value == "no" || value == "0") {
+    out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Config::load(const std::string &path) {
+  config_path = path;
+  ConfigSnapshot snapshot;
+  if (!parse(config_path, snapshot)) {
+    std::cerr << "Failed to load config: " << config_path << std::endl;
+    return false;
+  }
+  current.store(std::make_shared<const ConfigSnapshot>(std::move(snapshot)));
+  std::cout << "Config loaded from " << config_path << std::endl;
+  return true;
+}
+
+bool Config::reload() {
+  // 解析失败时保留旧快照
+  ConfigSnapshot snapshot;
+  if (!parse(config_path, snapshot)) {
+    std::cerr << "Failed to load config: " << config_path << std::endl;
+    return false;
+  }
+  auto old = current.load();
+  if (old->port != snapshot.port) {
+    std::cerr << "Listen port can not be changed at runtime" << std::endl;
+    snapshot.port = old->port;
+  }
+  current.store(std::make_shared<const ConfigSnapshot>(std::move(snapshot)));
+  std::cout << "Config loaded from " << config_path << std::endl;
+  return true;
+}
+
+std::shared_ptr<const ConfigSnapshot> Config::get() { return current.load(); }
+
+void Config::on_reload(std::function<void()> callback) {
+  reload_callbacks.push_back(std::move(callback));
+}
+
+void Config::watch() {
+  auto watcher = std::thread([] {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    while (true) {
+      int sig = 0;
+      if (sigwait(&set, &sig) != 0) {
+        continue;
+      }
+      std::cout << "SIGHUP received, reloading config" << std::endl;
+      if (reload()) {
+        for (const auto &callback : reload_callbacks) {
+          callback();
+        }
+      }
+    }
+  });
+  watcher.detach();
+}
+
+// 解析 ini 格式的配置文件
+// [server] 段为服务器参数，[users] 段为 帐号 = 密码
+bool Config::parse(const std::string &path, ConfigSnapshot &snapshot) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  bool has_users = false;
+  std::unordered_map<std::string, std::string> user_info;
+  std::string section;
+  std::string line;
+  int line_no = 0;
+  while (std::getline(file, line)) {
+    line_no++;
+    line = trim(line);
+    if (line.empty() || line[0] == '#' || line[0] == ';') {
+      continue;
+    }
+    if (line.front() == '[' && line.back() == ']') {
+      section = trim(line.substr(1, line.size() - 2));
+      if (section == "users") {
+        has_users = true;
+      }
+      continue;
+    }
+    auto pos = line.find('=');
+    if (pos == std::string::npos) {
+      std::cerr << path << ":" << line_no << ": missing '='" << std::endl;
+      return false;
+    }
+    auto key = trim(line.substr(0, pos));
+    auto value = trim(line.substr(pos + 1));
+    if (section == "users") {
+      user_info[key] = value;
+      continue;
+    }
+    if (section != "server") {
+      std::cerr << path << ":" << line_no << ": unknown section " << section
+                << std::endl;
+      return false;
+    }
+    bool ok = true;
+    if (key == "port") {
+      ok = parse_int(value, snapshot.port);
+    } else if (key == "buffer_size") {
+      ok = parse_int(value, snapshot.buffer_size) && snapshot.buffer_size > 0;
+    } else if (key == "buffer_pool_size") {
+      ok = parse_int(value, snapshot.buffer_pool_size);
+    } else if (key == "send_buffer_max") {
+      ok = parse_int(value, snapshot.send_buffer_max);
+    } else if (key == "drop_cache_size") {
+      ok = parse_int(value, snapshot.drop_cache_size);
+    } else if (key == "max_connections") {
+      ok = parse_int(value, snapshot.max_connections) &&
+           snapshot.max_connections > 0;
+    } else if (key == "io_threads") {
+      ok = parse_int(value, snapshot.io_threads) && snapshot.io_threads > 0;
+    } else if (key == "disk_threads") {
+      ok = parse_int(value, snapshot.disk_threads) && snapshot.disk_threads > 0;
+    } else if (key == "min_port") {
+      ok = parse_int(value, snapshot.min_port);
+    } else if (key == "max_port") {
+      ok = parse_int(value, snapshot.max_port);
+    } else if (key == "root_path") {
+      snapshot.root_path = value;
+    } else if (key == "storage") {
+      snapshot.storage = value;
+      ok = value == "local" || value == "tiered" || value == "dedup";
+    } else if (key == "cache_path") {
+      snapshot.cache_path = value;
+    } else if (key == "cache_size") {
+      ok = parse_int(value, snapshot.cache_size);
+    } else if (key == "cache_fill_threads") {
+      ok = parse_int(value, snapshot.cache_fill_threads) &&
+           snapshot.cache_fill_threads > 0;
+    } else if (key == "cache_fill_queue_size") {
+      ok = parse_int(value, snapshot.cache_fill_queue_size) &&
+           snapshot.cache_fill_queue_size > 0;
+    } else if (key == "dedup_path") {
+      snapshot.dedup_path = value;
+    } else if (key == "index") {
+      ok = parse_bool(value, snapshot.index);
+    } else if (key == "index_threads") {
+      ok = parse_int(value, snapshot.index_threads) &&
+           snapshot.index_threads > 0;
+    } else if (key == "archive_threads") {
+      ok = parse_int(value, snapshot.archive_threads) &&
+           snapshot.archive_threads > 0;
+    } else if (key == "recorder_size") {
+      ok = parse_int(value, snapshot.recorder_size) &&
+           snapshot.recorder_size >= 0;
+    } else if (key == "recorder_path") {
+      snapshot.recorder_path = value;
+    } else if (key == "admin_user") {
+      snapshot.admin_user = value;
+    } else if (key == "dir_cache_size") {
+      ok = parse_int(value, snapshot.dir_cache_size) &&
+           snapshot.dir_cache_size > 0;
+    } else if (key == "upgrade_socket") {
+      snapshot.upgrade_socket = value;
+    } else if (key == "drain_timeout") {
+      ok = parse_int(value, snapshot.drain_timeout);
+    } else if (key == "user_file") {
+      snapshot.user_file = value;
+    } else if (key == "auth_threads") {
+      ok = parse_int(value, snapshot.auth_threads) && snapshot.auth_threads > 0;
+    } else if (key == "auth_queue_size") {
+      ok = parse_int(value, snapshot.auth_queue_size) &&
+           snapshot.auth_queue_size > 0;
+    } else if (key == "auth_cache_ttl") {
+      ok = parse_int(value, snapshot.auth_cache_ttl);
+    } else if (key == "tls_cert") {
+      snapshot.tls_cert = value;
+    } else if (key == "tls_key") {
+      snapshot.tls_key = value;
+    } else if (key == "tls_required") {
+      ok = parse_bool(value, snapshot.tls_required);
+    } else if (key == "ktls") {
+      ok = parse_bool(value, snapshot.ktls);
+    } else {
+      std::cerr << path << ":" << line_no << ": unknown key " << key
+                << std::endl;
+      return false;
+    }
+    if (!ok) {
+      std::cerr << path << ":" << line_no << ": invalid value " << value
+                << std::endl;
+      return false;
+    }
+  }
+  if (snapshot.min_port > snapshot.max_port) {
+    std::cerr << path << ": min_port is greater than max_port" << std::endl;
+    return false;
+  }
+  if (has_users) {
+    snapshot.user_info = std::move(user_info);
+  }
+  return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "configs.hpp"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ftp {
+
+// 运行时配置快照，创建后不可修改
+// 默认值取自 configs.hpp，可被配置文件覆盖
+struct ConfigSnapshot {
+  int port = PORT;                             // 监听端口号，仅启动时生效
+  int buffer_size = BUFFER_SIZE;               // 缓冲区大小
+  int buffer_pool_size = BUFFER_POOL_SIZE;     // 传输缓冲池缓存上限
+  int send_buffer_max = SEND_BUFFER_MAX;       // 发送缓冲区上限（KiB）
+  int drop_cache_size = DROP_CACHE_SIZE;       // 丢弃页缓存的文件大小（MiB）
+  int max_connections = MAX_CONNECTIONS;       // 最大连接数
+  int io_threads = IO_THREADS;                 // 事件循环线程数
+  int disk_threads = DISK_THREADS;             // 执行阻塞文件操作的线程数
+  int min_port = MIN_PORT;                     // 被动模式最小端口号
+  int max_port = MAX_PORT;                     // 被动模式最大端口号
+  std::string root_path = ROOT_PATH;           // 根目录
+  int dir_cache_size = DIR_CACHE_SIZE;         // 目录句柄缓存数量
+  std::string storage = STORAGE;               // 存储后端
+  std::string cache_path = CACHE_PATH;         // 本地缓存目录
+  int cache_size = CACHE_SIZE;                 // 缓存目录容量（MiB）
+  int cache_fill_threads = CACHE_FILL_THREADS; // 填充缓存的线程数
+  int cache_fill_queue_size = CACHE_FILL_QUEUE_SIZE; // 等待填充的最大文件数
+  std::string dedup_path = DEDUP_PATH;         // 块存储目录
+  bool index = INDEX;                          // 是否维护命名空间索引
+  int index_threads = INDEX_THREADS;           // 建立索引时的扫描线程数
+  int archive_threads = ARCHIVE_THREADS;       // 打包下载时的预读线程数
+  int recorder_size = RECORDER_SIZE;           // 飞行记录器保留的命令数
+  std::string recorder_path = RECORDER_PATH;   // 写出记录的文件
+  std::string admin_user = ADMIN_USER;         // 可执行 SITE DUMP 的帐号
+  std::string upgrade_socket = UPGRADE_SOCKET; // 热升级交接套接字路径
+  int drain_timeout = DRAIN_TIMEOUT;           // 热升级时等待会话结束的秒数
+  std::string user_file = USER_FILE;           // 帐号文件路径
+  int auth_threads = AUTH_THREADS;             // 认证线程数
+  int auth_queue_size = AUTH_QUEUE_SIZE;       // 等待认证的最大登陆请求数
+  int auth_cache_ttl = AUTH_CACHE_TTL;         // 校验成功结果的缓存秒数
+  std::string tls_cert = TLS_CERT;             // 证书链文件
+  std::string tls_key = TLS_KEY;               // 私钥文件
+  bool tls_required = TLS_REQUIRED;            // 是否要求加密
+  bool ktls = KTLS;                            // 是否尝试使用内核 TLS
+  std::unordered_map<std::string, std::string> user_info =
+      USER_INFO; // 可登陆的帐号密码
+};
+
+class Config {
+public:
+  // 加载配置文件，成功后原子替换当前快照
+  static bool load(const std::string &path);
+  // 重新加载上一次加载的配置文件
+  static bool reload();
+  // 获取当前快照，持有者在使用期间不受重载影响
+  static std::shared_ptr<const ConfigSnapshot> get();
+  // 注册重载成功后的回调，需在 watch 之前调用
+  static void on_reload(std::function<void()> callback);
+  // 启动 SIGHUP 监听线程，调用前需在主线程屏蔽 SIGHUP
+  static void watch();
+
+private:
+  Config() = default;
+  ~Config() = default;
+  Config(const Config &) = delete;
+  Config(Config &&) = delete;
+  Config &operator=(const Config &) = delete;
+  Config &operator=(Config &&) = delete;
+
+  static bool parse(const std::string &path, ConfigSnapshot &snapshot);
+
+private:
+  // 当前生效的配置快照
+  static std::atomic<std::shared_ptr<const ConfigSnapshot>> current;
+  // 配置文件路径
+  static std::string config_path;
+  // 重载成功后的回调
+  static std::vector<std::function<void()>> reload_callbacks;
+};
+
+} // namespace ftp
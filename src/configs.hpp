@@ -3,8 +3,15 @@
 #include <unordered_map>
 namespace ftp {
 
-constexpr int BUFFER_SIZE = 1024;  // 缓冲区大小
-constexpr int MAX_CONNECTIONS = 5; // 最大连接数
+constexpr int BUFFER_SIZE = 1024;                  // 缓冲区大小
+constexpr int BUFFER_POOL_SIZE = 64 * 1024 * 1024; // 传输缓冲池缓存上限
+constexpr int SEND_BUFFER_MAX = 0;                 // 发送缓冲区上限（KiB）
+constexpr int DROP_CACHE_SIZE = 1024;              // 丢弃页缓存的文件大小（MiB）
+constexpr int ARENA_SIZE = 4096;                   // 会话 arena 大小
+constexpr int MAX_CONNECTIONS = 5;                 // 最大连接数
+constexpr int IO_THREADS = 4;                      // 事件循环线程数
+constexpr int DISK_THREADS = 4;                    // 执行阻塞文件操作的线程数
+constexpr int DIR_CACHE_SIZE = 256;                // 目录句柄缓存数量
 
 constexpr int MAX_PORT = 21010; // 最大端口号
 constexpr int MIN_PORT = 21000; // 最小端口号
@@ -13,6 +20,34 @@ constexpr int PORT = 21; // FTP 默认端口
 
 const std::string ROOT_PATH = "./files";
 
+const std::string STORAGE = "local"; // 存储后端：local / tiered / dedup
+const std::string CACHE_PATH = "";   // tiered 模式下的本地缓存目录
+constexpr int CACHE_SIZE = 10240;    // 缓存目录容量（MiB）
+constexpr int CACHE_FILL_THREADS = 2;     // 填充缓存的线程数
+constexpr int CACHE_FILL_QUEUE_SIZE = 16; // 等待填充的最大文件数
+const std::string DEDUP_PATH = "";   // dedup 模式下的块存储目录
+
+constexpr bool INDEX = false;      // 是否在内存中维护命名空间索引
+constexpr int INDEX_THREADS = 4;   // 建立索引时的扫描线程数
+constexpr int ARCHIVE_THREADS = 4; // 打包下载目录时的预读线程数
+
+constexpr int RECORDER_SIZE = 4096;            // 飞行记录器保留的命令数
+const std::string RECORDER_PATH = "./ftp.rec"; // SIGUSR1 时写出记录的文件
+const std::string ADMIN_USER = "";             // 可执行 SITE DUMP 的帐号
+
+const std::string UPGRADE_SOCKET = "./ftp.sock"; // 热升级交接套接字路径
+constexpr int DRAIN_TIMEOUT = 30; // 热升级时旧进程等待会话结束的秒数
+
+const std::string USER_FILE = "";   // 帐号文件路径，为空时使用 USER_INFO
+constexpr int AUTH_THREADS = 2;     // 认证线程数
+constexpr int AUTH_QUEUE_SIZE = 64; // 等待认证的最大登陆请求数
+constexpr int AUTH_CACHE_TTL = 60;  // 校验成功结果的缓存秒数，0 为不缓存
+
+const std::string TLS_CERT = "";     // 证书链文件，为空时不支持 FTPS
+const std::string TLS_KEY = "";      // 私钥文件，为空时从证书文件读取
+constexpr bool TLS_REQUIRED = false; // 是否要求登陆与数据连接加密
+constexpr bool KTLS = true;          // 是否尝试使用内核 TLS
+
 const std::unordered_map<std::string, std::string> USER_INFO = {
     {"root", "root"},
     {"user", "user"},
@@ -0,0 +1,433 @@
+#include "dedup.hpp"
+#include "path.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <openssl/evp.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace ftp;
+
+// 清单首行的前缀
+static constexpr std::string_view MAGIC = "FTPCDC1 ";
+// 平均块长之前与之后的切点掩码，取哈希高位，覆盖最近 64 字节
+static constexpr uint64_t MASK_S = ~0ULL << (64 - 18);
+static constexpr uint64_t MASK_L = ~0ULL << (64 - 14);
+
+// Gear 表，每个字节值对应一个随机数
+static constexpr std::array<uint64_t, 256> GEAR = [] {
+  std::array<uint64_t, 256> table{};
+  uint64_t state = Chunker::SEED;
+  for (auto &value : table) {
+    state += 0x9e3779b97f4a7c15;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}();
+
+size_t Chunker::cut(const char *data, size_t size) {
+  if (size <= MIN_SIZE) {
+    return size;
+  }
+  size = std::min(size, MAX_SIZE);
+  size_t normal = std::min(size, AVG_SIZE);
+  auto bytes = reinterpret_cast<const unsigned char *>(data);
+  uint64_t hash = 0;
+  size_t i = MIN_SIZE;
+  for (; i < normal; i++) {
+    hash = (hash << 1) + GEAR[bytes[i]];
+    if ((hash & MASK_S) == 0) {
+      return i + 1;
+    }
+  }
+  for (; i < size; i++) {
+    hash = (hash << 1) + GEAR[bytes[i]];
+    if ((hash & MASK_L) == 0) {
+      return i + 1;
+    }
+  }
+  return size;
+}
+
+// 清单引用的一个块
+struct ChunkRef {
+  std::string hash; // 块摘要
+  uint64_t offset;  // 在文件中的偏移
+  uint64_t size;    // 块长度
+};
+
+struct DedupStorage::Manifest {
+  uint64_t size = 0;            // 文件大小
+  std::vector<ChunkRef> chunks; // 按偏移排列的块
+};
+
+// 按清单从各块读取内容，不能使用 sendfile
+class DedupStorage::ManifestFile : public ReadFile {
+public:
+  ManifestFile(int chunk_dir, Manifest manifest)
+      : ReadFile(-1, manifest.size), chunk_dir(chunk_dir),
+        chunks(std::move(manifest.chunks)) {}
+
+  ~ManifestFile() override {
+    if (chunk_fd >= 0) {
+      close(chunk_fd);
+    }
+  }
+
+  // 跨越块边界的读取在同一缓冲区中拼接，每次发送尽量填满缓冲区
+  ssize_t read(char *data, size_t size, size_t offset) override {
+    if (offset >= size_) {
+      return 0;
+    }
+    auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), offset,
+        [](size_t value, const ChunkRef &chunk) {
+          return value < chunk.offset;
+        });
+    --it;
+    size_t total = 0;
+    while (total < size && it != chunks.end()) {
+      size_t skip = offset + total - it->offset;
+      size_t count = std::min<size_t>(it->size - skip, size - total);
+      if (!open_chunk(it - chunks.begin())) {
+        return -1;
+      }
+      ssize_t n = pread(chunk_fd, data + total, count, skip);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        // 块文件被截断或损坏
+        std::cerr << "Failed to read chunk " << it->hash << std::endl;
+        return -1;
+      }
+      total += n;
+      if (static_cast<size_t>(n) == it->size - skip) {
+        ++it;
+      }
+    }
+    return total;
+  }
+
+private:
+  // 保持最近读取的块打开，顺序下载时每个块只打开一次
+  bool open_chunk(size_t index) {
+    if (index == chunk_index) {
+      return true;
+    }
+    if (chunk_fd >= 0) {
+      close(chunk_fd);
+    }
+    chunk_index = index;
+    chunk_fd = openat(chunk_dir, chunk_path(chunks[index].hash).c_str(),
+                      O_RDONLY | O_CLOEXEC);
+    if (chunk_fd < 0) {
+      chunk_index = SIZE_MAX;
+      std::cerr << "Missing chunk " << chunks[index].hash << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  int chunk_dir;                // 块存储目录
+  std::vector<ChunkRef> chunks; // 按偏移排列的块
+  size_t chunk_index = SIZE_MAX; // 当前打开的块
+  int chunk_fd = -1;             // 当前打开的块文件
+};
+
+// 上传时边接收边分块，提交时写入清单
+class DedupStorage::DedupWriteFile : public WriteFile {
+public:
+  DedupWriteFile(DedupStorage *storage, std::unique_ptr<WriteFile> manifest)
+      : storage(storage), manifest(std::move(manifest)) {
+    pending.reserve(Chunker::MAX_SIZE * 2);
+  }
+
+  ssize_t write(const char *data, size_t size) override {
+    pending.insert(pending.end(), data, data + size);
+    // 凑满最大块长后切点才确定
+    while (pending.size() >= Chunker::MAX_SIZE) {
+      if (!emit(Chunker::cut(pending.data(), pending.size()))) {
+        return -1;
+      }
+    }
+    return size;
+  }
+
+  bool commit() override {
+    while (!pending.empty()) {
+      if (!emit(Chunker::cut(pending.data(), pending.size()))) {
+        return false;
+      }
+    }
+    std::string header = std::format("{}{}\n", MAGIC, size);
+    return manifest->write(header.data(), header.size()) >= 0 &&
+           manifest->write(entries.data(), entries.size()) >= 0 &&
+           manifest->commit();
+  }
+
+private:
+  // 保存 pending 开头的 count 字节并记入清单
+  bool emit(size_t count) {
+    std::string hash = storage->store_chunk(pending.data(), count);
+    if (hash.empty()) {
+      return false;
+    }
+    std::format_to(std::back_inserter(entries), "{} {}\n", hash, count);
+    size += count;
+    pending.erase(pending.begin(), pending.begin() + count);
+    return true;
+  }
+
+private:
+  DedupStorage *storage;               // 所属存储
+  std::unique_ptr<WriteFile> manifest; // 清单文件
+  std::vector<char> pending;           // 尚未切分的数据
+  std::string entries;                 // 已保存的块
+  uint64_t size = 0;                   // 已切分的字节数
+};
+
+static bool is_hash(std::string_view hash) {
+  return hash.size() == 64 &&
+         std::ranges::all_of(hash, [](char c) {
+           return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+         });
+}
+
+template <typename T> static bool parse_number(std::string_view text, T &out) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+// 读取清单首行中的文件大小，不是清单时返回 false
+static bool read_header(int fd, uint64_t &size) {
+  char header[64];
+  ssize_t n = pread(fd, header, sizeof(header), 0);
+  if (n <= static_cast<ssize_t>(MAGIC.size())) {
+    return false;
+  }
+  std::string_view text(header, n);
+  if (!text.starts_with(MAGIC)) {
+    return false;
+  }
+  text.remove_prefix(MAGIC.size());
+  size_t end = text.find('\n');
+  return end != std::string_view::npos &&
+         parse_number(text.substr(0, end), size);
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = ::write(fd, data + total, size - total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    total += n;
+  }
+  return true;
+}
+
+std::shared_ptr<DedupStorage>
+DedupStorage::create(const std::string &dedup_path) {
+  if (dedup_path.empty()) {
+    std::cerr << "dedup_path is required for dedup storage" << std::endl;
+    return nullptr;
+  }
+  mkdir(dedup_path.c_str(), 0755);
+  int fd = open(dedup_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Failed to open dedup path " << dedup_path << ": "
+              << strerror(errno) << std::endl;
+    return nullptr;
+  }
+  return std::make_shared<DedupStorage>(fd);
+}
+
+DedupStorage::~DedupStorage() { close(chunk_fd); }
+
+std::string DedupStorage::chunk_path(std::string_view hash) {
+  return std::string(hash.substr(0, 2)) + "/" + std::string(hash.substr(2));
+}
+
+bool DedupStorage::parse_manifest(std::string_view text, Manifest &manifest) {
+  size_t end = text.find('\n');
+  if (!text.starts_with(MAGIC) || end == std::string_view::npos ||
+      !parse_number(text.substr(MAGIC.size(), end - MAGIC.size()),
+                    manifest.size)) {
+    return false;
+  }
+  text.remove_prefix(end + 1);
+  uint64_t offset = 0;
+  while (!text.empty()) {
+    end = text.find('\n');
+    if (end == std::string_view::npos) {
+      return false;
+    }
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(end + 1);
+    size_t space = line.find(' ');
+    uint64_t size = 0;
+    if (space == std::string_view::npos || !is_hash(line.substr(0, space)) ||
+        !parse_number(line.substr(space + 1), size) || size == 0) {
+      return false;
+    }
+    manifest.chunks.push_back(
+        {std::string(line.substr(0, space)), offset, size});
+    offset += size;
+  }
+  return offset == manifest.size;
+}
+
+bool DedupStorage::has_chunk(std::string_view hash) {
+  return is_hash(hash) &&
+         faccessat(chunk_fd, chunk_path(hash).c_str(), F_OK, 0) == 0;
+}
+
+std::string DedupStorage::store_chunk(const char *data, size_t size,
+                                      std::string_view expected) {
+  static std::atomic<uint64_t> chunk_id = 0;
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_size = 0;
+  if (EVP_Digest(data, size, digest, &digest_size, EVP_sha256(), nullptr) !=
+      1) {
+    return "";
+  }
+  static constexpr char HEX[] = "0123456789abcdef";
+  std::string hash;
+  for (unsigned int i = 0; i < digest_size; i++) {
+    hash.push_back(HEX[digest[i] >> 4]);
+    hash.push_back(HEX[digest[i] & 15]);
+  }
+  if (!expected.empty() && expected != hash) {
+    return "";
+  }
+  std::string path = chunk_path(hash);
+  if (faccessat(chunk_fd, path.c_str(), F_OK, 0) == 0) {
+    return hash;
+  }
+  // 先写入临时文件再重命名，并发保存同一块时结果相同
+  mkdirat(chunk_fd, hash.substr(0, 2).c_str(), 0755);
+  std::string temp = path + "." + std::to_string(getpid()) + "." +
+                     std::to_string(chunk_id.fetch_add(1)) + ".tmp";
+  int fd = openat(chunk_fd, temp.c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to create chunk " << hash << ": " << strerror(errno)
+              << std::endl;
+    return "";
+  }
+  bool ok = write_all(fd, data, size);
+  ok = close(fd) == 0 && ok;
+  if (!ok || renameat(chunk_fd, temp.c_str(), chunk_fd, path.c_str()) < 0) {
+    std::cerr << "Failed to write chunk " << hash << ": " << strerror(errno)
+              << std::endl;
+    unlinkat(chunk_fd, temp.c_str(), 0);
+    return "";
+  }
+  return hash;
+}
+
+bool DedupStorage::commit_manifest(const Client &session,
+                                   std::string_view path,
+                                   std::string_view manifest) {
+  Manifest parsed;
+  if (!parse_manifest(manifest, parsed)) {
+    errno = EINVAL;
+    return false;
+  }
+  for (auto &chunk : parsed.chunks) {
+    struct stat chunk_stat;
+    if (fstatat(chunk_fd, chunk_path(chunk.hash).c_str(), &chunk_stat, 0) <
+            0 ||
+        static_cast<uint64_t>(chunk_stat.st_size) != chunk.size) {
+      errno = ENODATA;
+      return false;
+    }
+  }
+  auto file = LocalStorage::open_write(session, path);
+  return file != nullptr &&
+         file->write(manifest.data(), manifest.size()) >= 0 && file->commit();
+}
+
+std::unique_ptr<ReadFile> DedupStorage::open_file(int fd) {
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    close(fd);
+    errno = EISDIR;
+    return nullptr;
+  }
+  uint64_t size = 0;
+  if (!read_header(fd, size)) {
+    // 启用去重前已有的文件
+    return std::make_unique<ReadFile>(fd, file_stat.st_size);
+  }
+  std::string text(file_stat.st_size, '\0');
+  size_t total = 0;
+  while (total < text.size()) {
+    ssize_t n = pread(fd, text.data() + total, text.size() - total, total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    total += n;
+  }
+  Manifest manifest;
+  if (total != text.size() || !parse_manifest(text, manifest)) {
+    std::cerr << "Invalid manifest" << std::endl;
+    close(fd);
+    errno = EIO;
+    return nullptr;
+  }
+  close(fd);
+  return std::make_unique<ManifestFile>(chunk_fd, std::move(manifest));
+}
+
+std::unique_ptr<WriteFile> DedupStorage::open_write(const Client &session,
+                                                    std::string_view path) {
+  auto manifest = LocalStorage::open_write(session, path);
+  if (manifest == nullptr) {
+    return nullptr;
+  }
+  return std::make_unique<DedupWriteFile>(this, std::move(manifest));
+}
+
+int DedupStorage::stat_at(int dir_fd, const char *name, struct stat &status) {
+  if (fstatat(dir_fd, name, &status, AT_SYMLINK_NOFOLLOW) < 0) {
+    return -1;
+  }
+  if (!S_ISREG(status.st_mode)) {
+    return 0;
+  }
+  // 清单显示为原文件的大小
+  int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  uint64_t size = 0;
+  if (read_header(fd, size)) {
+    status.st_size = size;
+  }
+  close(fd);
+  return 0;
+}
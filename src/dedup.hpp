@@ -0,0 +1,82 @@
+#pragma once
+#include "storage.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace ftp {
+
+// FastCDC 内容定义分块
+// 以 Gear 滚动哈希寻找切点，插入或删除数据只影响附近的块边界；
+// 平均块长之前使用更严格的掩码，使块长集中在平均值附近
+// Gear 表由 splitmix64 以固定种子生成，客户端按相同参数分块可得到相同的块
+class Chunker {
+public:
+  static constexpr size_t MIN_SIZE = 16 * 1024;  // 最小块长
+  static constexpr size_t AVG_SIZE = 64 * 1024;  // 平均块长
+  static constexpr size_t MAX_SIZE = 256 * 1024; // 最大块长
+  static constexpr uint64_t SEED = 0x66747063646331; // Gear 表种子
+
+  // 返回 data 开头第一个块的长度
+  // 数据不足 MAX_SIZE 时只有在文件末尾才能确定切点
+  static size_t cut(const char *data, size_t size);
+
+private:
+  Chunker() = default;
+  ~Chunker() = default;
+  Chunker(const Chunker &) = delete;
+  Chunker(Chunker &&) = delete;
+  Chunker &operator=(const Chunker &) = delete;
+  Chunker &operator=(Chunker &&) = delete;
+};
+
+// 去重存储：上传内容经 FastCDC 分块，块按 SHA-256 保存在 dedup_path 中，
+// 根目录下的文件是引用这些块的清单，下载时按清单把各块拼接成原文件
+// 清单为文本，首行 "FTPCDC1 <文件大小>"，其后每行 "<块摘要> <块长度>"
+// 客户端可先用 SITE HAVE 查询已有的块，只上传缺少的块，再提交清单
+// 未分块的已有文件按原样读取；不再被引用的块不会自动删除
+class DedupStorage : public LocalStorage {
+public:
+  // 经 SITE CHUNK 上传的单个块的最大长度
+  static constexpr size_t CHUNK_LIMIT = 4 * 1024 * 1024;
+  // 经 SITE COMMIT 上传的清单的最大长度
+  static constexpr size_t MANIFEST_LIMIT = 64 * 1024 * 1024;
+
+  // 打开块存储目录，失败返回 nullptr
+  static std::shared_ptr<DedupStorage> create(const std::string &dedup_path);
+
+  explicit DedupStorage(int chunk_fd) : chunk_fd(chunk_fd) {}
+  ~DedupStorage() override;
+
+  std::unique_ptr<WriteFile> open_write(const Client &session,
+                                        std::string_view path) override;
+  int stat_at(int dir_fd, const char *name, struct stat &status) override;
+
+  // 是否已有该摘要（小写十六进制 SHA-256）的块
+  bool has_chunk(std::string_view hash);
+  // 保存一个块并返回其摘要，expected 非空时内容必须与之相符，失败返回空串
+  std::string store_chunk(const char *data, size_t size,
+                          std::string_view expected = {});
+  // 校验清单中的块都已存在后创建文件，失败返回 false 并设置 errno
+  // 清单格式错误时为 EINVAL，引用了不存在的块时为 ENODATA
+  bool commit_manifest(const Client &session, std::string_view path,
+                       std::string_view manifest);
+
+protected:
+  std::unique_ptr<ReadFile> open_file(int fd) override;
+
+private:
+  struct Manifest;
+  class ManifestFile;
+  class DedupWriteFile;
+
+  // 解析清单文本，格式不正确时返回 false
+  static bool parse_manifest(std::string_view text, Manifest &manifest);
+  // 块在存储目录中的相对路径：摘要前两位为子目录
+  static std::string chunk_path(std::string_view hash);
+
+private:
+  int chunk_fd; // 块存储目录
+};
+
+} // namespace ftp
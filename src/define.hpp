@@ -1,12 +1,21 @@
 #pragma once
+#include "recorder.hpp"
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <netinet/in.h>
+#include <openssl/types.h>
 #include <string>
+#include <string_view>
 namespace ftp {
 
+class DirHandle;
+
 constexpr int COMMON = 0; // 普通返回值
 constexpr int CREATE_SOCKET_ERROR = -1;
 constexpr int BIND_SOCKET_ERROR = -2;
 constexpr int SERVER_INNER_ERROR = -3;
+constexpr int AUTH_BUSY = -4; // 认证队列已满
 
 enum class Command {
   USER,
@@ -16,20 +25,50 @@ enum class Command {
   LCD,
   QUIT,
   RETR,
+  STOR,
+  CWD,
+  CDUP,
   PWD,
   SYST,
   EPSV,
   PASV,
   TYPE,
   PORT,
+  AUTH,
+  PBSZ,
+  PROT,
+  SITE,
+  MODE,
+  REST,
   ERROR,
 };
 
+// 支持以 string_view 查找的哈希，避免构造临时 std::string
+struct StringHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view str) const {
+    return std::hash<std::string_view>{}(str);
+  }
+};
+
 struct Client {
-  sockaddr_in address;      // 客户端地址
-  int client_fd;            // 通信文件描述符
-  int data_fd;              // 数据传输文件描述符
-  bool is_positive = false; // 数据传输模式
-  std::string curr_path;    // 当前路径
+  sockaddr_in address;            // 客户端地址
+  int client_fd = -1;             // 通信文件描述符
+  int data_fd = -1;               // 数据传输文件描述符
+  bool is_positive = false;       // 数据传输模式
+  std::string curr_path;          // 当前路径
+  std::shared_ptr<DirHandle> cwd; // 当前目录句柄
+  SSL *ssl = nullptr;             // 控制连接的 TLS 会话，AUTH TLS 后建立
+  bool pbsz = false;              // 是否已协商 PBSZ
+  bool protect_data = false;      // 数据连接是否加密（PROT P）
+  bool block_mode = false;        // 传输模式是否为 MODE B
+  bool data_open = false;         // data_fd 是块模式下保持的数据连接
+  SSL *data_ssl = nullptr;        // 保持的数据连接的 TLS 会话
+  uint64_t restart = 0;           // REST 设置的下一次下载起点
+  uint64_t session_id = 0;        // 会话编号，记录器中用于区分会话
+  int64_t pasv_ready = 0;         // 最近一次被动模式监听就绪的时间
+  Recorder::Trace trace;          // 正在处理的命令的记录
+  std::pmr::memory_resource *arena =
+      std::pmr::get_default_resource(); // 会话 arena，每条命令后重置
 };
 } // namespace ftp
\ No newline at end of file
@@ -0,0 +1,313 @@
+#include "executor.hpp"
+#include "config.hpp"
+#include "define.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ftp;
+
+namespace {
+
+// 分离执行的顶层协程，结束后自动销毁
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+Detached run_detached(Task<int> task) {
+  try {
+    co_await task;
+  } catch (const std::exception &ex) {
+    std::cerr << "Unhandled error in session: " << ex.what() << std::endl;
+  }
+}
+
+// 非阻塞操作是否需要等待后重试
+bool would_block() {
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+} // namespace
+
+struct Executor::Loop {
+  int epoll_fd = -1;
+  int event_fd = -1; // 唤醒事件循环处理新任务
+  std::thread thread;
+  std::atomic<bool> stopping = false; // 处理完本轮事件后退出
+  std::mutex pending_mutex;
+  std::vector<Task<int>> pending;             // 等待启动的任务
+  std::vector<std::coroutine_handle<>> ready; // 其他线程交回的协程
+
+  Loop() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_fd < 0 || event_fd < 0) {
+      std::cerr << "Failed to create event loop" << std::endl;
+      exit(SERVER_INNER_ERROR);
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+  }
+
+  void post(Task<int> task) {
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex);
+      pending.push_back(std::move(task));
+    }
+    wake();
+  }
+
+  void post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex);
+      ready.push_back(handle);
+    }
+    wake();
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    write(event_fd, &one, sizeof(one));
+  }
+
+  void run();
+};
+
+// 当前线程所属的事件循环
+thread_local Executor::Loop *Executor::current_loop = nullptr;
+// 事件循环，只由 accept 线程扩容
+inline std::vector<std::unique_ptr<Executor::Loop>> Executor::loops;
+// 下一个分配的事件循环
+inline size_t Executor::next_loop = 0;
+// 等待磁盘线程执行的任务
+inline std::deque<std::pair<void (*)(void *), void *>> Executor::disk_jobs;
+// 保护 disk_jobs、disk_workers 与 disk_stopping 的互斥锁
+inline std::mutex Executor::disk_mutex;
+inline std::condition_variable Executor::disk_cv;
+// 已启动的磁盘线程
+inline std::vector<std::thread> Executor::disk_workers;
+// 通知磁盘线程退出
+inline bool Executor::disk_stopping = false;
+
+void Executor::Loop::run() {
+  current_loop = this;
+  epoll_event events[64];
+  std::vector<Task<int>> starting;
+  std::vector<std::coroutine_handle<>> resuming;
+  while (!stopping) {
+    int n = epoll_wait(epoll_fd, events, 64, -1);
+    if (n < 0) {
+      if (errno != EINTR) {
+        std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+      }
+      continue;
+    }
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr != nullptr) {
+        std::coroutine_handle<>::from_address(events[i].data.ptr).resume();
+        continue;
+      }
+      uint64_t count;
+      read(event_fd, &count, sizeof(count));
+      {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        starting.swap(pending);
+        resuming.swap(ready);
+      }
+      for (auto &task : starting) {
+        run_detached(std::move(task));
+      }
+      starting.clear();
+      for (auto handle : resuming) {
+        handle.resume();
+      }
+      resuming.clear();
+    }
+  }
+}
+
+void Executor::spawn(Task<int> task) {
+  size_t threads = std::max(1, Config::get()->io_threads);
+  // 线程数只增不减，调小时新会话只分配到前 threads 个事件循环
+  while (loops.size() < threads) {
+    auto loop = std::make_unique<Loop>();
+    loop->thread = std::thread(&Loop::run, loop.get());
+    loops.push_back(std::move(loop));
+  }
+  next_loop = (next_loop + 1) % threads;
+  loops[next_loop]->post(std::move(task));
+}
+
+void Executor::stop() {
+  for (auto &loop : loops) {
+    loop->stopping = true;
+    loop->wake();
+  }
+  for (auto &loop : loops) {
+    loop->thread.join();
+  }
+  // 已提交的任务执行完再退出，结果不再交回协程
+  {
+    std::lock_guard<std::mutex> lock(disk_mutex);
+    disk_stopping = true;
+  }
+  disk_cv.notify_all();
+  for (auto &worker : disk_workers) {
+    worker.join();
+  }
+}
+
+Executor::Loop *Executor::current() { return current_loop; }
+
+void Executor::resume_on(Loop *loop, std::coroutine_handle<> handle) {
+  loop->post(handle);
+}
+
+void Executor::submit(void (*run)(void *), void *arg) {
+  int threads = std::max(1, Config::get()->disk_threads);
+  std::lock_guard<std::mutex> lock(disk_mutex);
+  // 线程数只增不减
+  while (disk_workers.size() < static_cast<size_t>(threads)) {
+    disk_workers.emplace_back(&Executor::disk_worker);
+  }
+  disk_jobs.emplace_back(run, arg);
+  disk_cv.notify_one();
+}
+
+void Executor::disk_worker() {
+  while (true) {
+    std::pair<void (*)(void *), void *> job;
+    {
+      std::unique_lock<std::mutex> lock(disk_mutex);
+      disk_cv.wait(lock, [] { return disk_stopping || !disk_jobs.empty(); });
+      if (disk_jobs.empty()) {
+        return;
+      }
+      job = disk_jobs.front();
+      disk_jobs.pop_front();
+    }
+    job.first(job.second);
+  }
+}
+
+Executor::IoAwaiter Executor::readable(int fd) { return {fd, EPOLLIN}; }
+
+Executor::IoAwaiter Executor::writable(int fd) { return {fd, EPOLLOUT}; }
+
+bool Executor::watch(int fd, uint32_t events,
+                     std::coroutine_handle<> handle) {
+  epoll_event ev{};
+  ev.events = events | EPOLLONESHOT | EPOLLRDHUP;
+  ev.data.ptr = handle.address();
+  // fd 已注册过时重新激活，否则新增
+  if (epoll_ctl(current_loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+      epoll_ctl(current_loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    std::cerr << "Failed to watch fd " << fd << ": " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+Task<ssize_t> Executor::async_recv(int fd, char *data, size_t size) {
+  while (true) {
+    ssize_t n = recv(fd, data, size, MSG_DONTWAIT);
+    if (n >= 0 || !would_block()) {
+      co_return n;
+    }
+    if (co_await readable(fd) != 0) {
+      co_return -1;
+    }
+  }
+}
+
+Task<ssize_t> Executor::async_send(int fd, const char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n =
+        send(fd, data + total, size - total, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n >= 0) {
+      total += n;
+      continue;
+    }
+    if (!would_block()) {
+      co_return -1;
+    }
+    if (co_await writable(fd) != 0) {
+      co_return -1;
+    }
+  }
+  co_return total;
+}
+
+Task<int> Executor::async_accept(int listen_fd, sockaddr_in &address) {
+  while (true) {
+    socklen_t addr_len = sizeof(address);
+    int fd = accept4(listen_fd, (sockaddr *)&address, &addr_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd >= 0 || !would_block()) {
+      co_return fd;
+    }
+    if (co_await readable(listen_fd) != 0) {
+      co_return -1;
+    }
+  }
+}
+
+// fd 需为非阻塞套接字，文件提前结束时返回已发送的字节数
+Task<ssize_t> Executor::async_sendfile(int fd, int file_fd, off_t offset,
+                                       size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = ::sendfile(fd, file_fd, &offset, size - total);
+    if (n > 0) {
+      total += n;
+      continue;
+    }
+    if (n == 0) {
+      break;
+    }
+    if (!would_block()) {
+      co_return -1;
+    }
+    if (co_await writable(fd) != 0) {
+      co_return -1;
+    }
+  }
+  co_return total;
+}
+
+// fd 需为非阻塞套接字
+Task<int> Executor::async_connect(int fd, const sockaddr_in &address) {
+  if (connect(fd, (const sockaddr *)&address, sizeof(address)) == 0) {
+    co_return 0;
+  }
+  if (errno != EINPROGRESS) {
+    co_return -1;
+  }
+  if (co_await writable(fd) != 0) {
+    co_return -1;
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+    co_return -1;
+  }
+  co_return 0;
+}
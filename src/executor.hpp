@@ -0,0 +1,149 @@
+#pragma once
+#include "task.hpp"
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ftp {
+
+// 协程执行器：若干事件循环线程，每个线程一个 epoll
+// 会话协程固定在启动它的事件循环上运行，等待 IO 时只占用协程帧
+class Executor {
+public:
+  struct Loop;
+
+  // 等待 fd 就绪的 awaiter，返回 0；注册失败时不挂起，返回 errno
+  struct IoAwaiter {
+    int fd;
+    uint32_t events;
+    int error = 0;
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+      if (!watch(fd, events, handle)) {
+        error = errno;
+        return false;
+      }
+      return true;
+    }
+    int await_resume() const noexcept {
+      if (error != 0) {
+        errno = error;
+      }
+      return error;
+    }
+  };
+
+  // 让出事件循环，排在已就绪的其他协程之后恢复
+  struct YieldAwaiter {
+    bool await_ready() const noexcept { return current() == nullptr; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      resume_on(current(), handle);
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // 在磁盘线程中执行 job 的 awaiter，完成后回到原事件循环恢复协程
+  // job 保存在协程帧中，提交时不分配内存；job 留下的 errno 带回协程
+  template <typename F> struct BlockingAwaiter {
+    F job;
+    decltype(std::declval<F &>()()) result{};
+    int error = 0;
+    Loop *loop = nullptr;
+    std::coroutine_handle<> handle = nullptr;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> awaiting) {
+      loop = current();
+      handle = awaiting;
+      if (loop == nullptr) {
+        // 不在事件循环上时直接执行
+        result = job();
+        return false;
+      }
+      submit(&BlockingAwaiter::run, this);
+      return true;
+    }
+    auto await_resume() {
+      if (loop != nullptr) {
+        errno = error;
+      }
+      return std::move(result);
+    }
+
+    static void run(void *self) {
+      auto awaiter = static_cast<BlockingAwaiter *>(self);
+      awaiter->result = awaiter->job();
+      awaiter->error = errno;
+      resume_on(awaiter->loop, awaiter->handle);
+    }
+  };
+
+  // 将协程任务分派到事件循环，按配置的线程数轮询分配
+  static void spawn(Task<int> task);
+  // 通知所有事件循环与磁盘线程退出并等待其结束，仍挂起的协程不再恢复
+  static void stop();
+  // 当前线程所属的事件循环，非事件循环线程返回 nullptr
+  static Loop *current();
+  // 在指定事件循环上恢复协程，可在任意线程调用
+  static void resume_on(Loop *loop, std::coroutine_handle<> handle);
+
+  static YieldAwaiter yield() { return {}; }
+  static IoAwaiter readable(int fd);
+  static IoAwaiter writable(int fd);
+
+  // 非阻塞 IO，未就绪时挂起当前协程
+  static Task<ssize_t> async_recv(int fd, char *data, size_t size);
+  static Task<ssize_t> async_send(int fd, const char *data, size_t size);
+  static Task<int> async_accept(int listen_fd, sockaddr_in &address);
+  // 从文件 offset 处零拷贝发送 size 字节到套接字
+  static Task<ssize_t> async_sendfile(int fd, int file_fd, off_t offset,
+                                      size_t size);
+  static Task<int> async_connect(int fd, const sockaddr_in &address);
+  // 在磁盘线程中执行会阻塞的文件操作，返回 job 的结果
+  template <typename F> static BlockingAwaiter<F> blocking(F job) {
+    return {std::move(job)};
+  }
+
+private:
+  Executor() = default;
+  ~Executor() = default;
+  Executor(const Executor &) = delete;
+  Executor(Executor &&) = delete;
+  Executor &operator=(const Executor &) = delete;
+  Executor &operator=(Executor &&) = delete;
+
+  // 在当前事件循环注册一次性的 fd 事件，就绪后恢复 handle
+  // 注册失败返回 false，协程不挂起
+  static bool watch(int fd, uint32_t events, std::coroutine_handle<> handle);
+  // 提交到磁盘线程，按配置的线程数按需启动
+  static void submit(void (*run)(void *), void *arg);
+  static void disk_worker();
+
+private:
+  // 当前线程所属的事件循环
+  static thread_local Loop *current_loop;
+  // 事件循环，只由 accept 线程扩容
+  static std::vector<std::unique_ptr<Loop>> loops;
+  // 下一个分配的事件循环
+  static size_t next_loop;
+  // 等待磁盘线程执行的任务
+  static std::deque<std::pair<void (*)(void *), void *>> disk_jobs;
+  // 保护 disk_jobs、disk_workers 与 disk_stopping 的互斥锁
+  static std::mutex disk_mutex;
+  static std::condition_variable disk_cv;
+  // 已启动的磁盘线程
+  static std::vector<std::thread> disk_workers;
+  // 通知磁盘线程退出
+  static bool disk_stopping;
+};
+
+} // namespace ftp
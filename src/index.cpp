@@ -0,0 +1,386 @@
+#include "index.hpp"
+#include "config.hpp"
+#include "storage.hpp"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <shared_mutex>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace ftp;
+
+// 需要跟踪的目录事件，文件内容的变化在写入完成时更新一次
+static constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                       IN_MOVED_TO | IN_CLOSE_WRITE |
+                                       IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// 一个索引实例，由后台线程与查询共享
+struct Index::State {
+  std::string root_path;    // 根目录的实际路径
+  int root_fd = -1;         // 根目录
+  int inotify_fd = -1;      // inotify 实例
+  int wake_fd = -1;         // 停止时唤醒后台线程
+  std::atomic<bool> ready = false;
+  // 保护 root，查询持读锁；后台线程是唯一的写者，读取无需加锁，
+  // 只在把扫描结果接入路径树时短暂持有写锁
+  std::shared_mutex mutex;
+  Node root;                // 路径树
+  std::mutex watch_mutex;   // 保护 watches，并行扫描时同时添加
+  std::unordered_map<int, std::string> watches; // 监视描述符 与 相对路径
+  std::atomic<size_t> entries = 0; // 扫描过的条目数
+
+  ~State() {
+    for (int fd : {root_fd, inotify_fd, wake_fd}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+};
+
+// 等待扫描的目录
+struct Index::Job {
+  Node *node;       // 目录节点
+  std::string path; // 相对根目录的路径，根目录为空串
+  int fd;           // 已打开的目录
+};
+
+inline std::atomic<std::shared_ptr<Index::State>> Index::current;
+
+static std::string join(std::string_view dir, std::string_view name) {
+  std::string path(dir);
+  if (!path.empty()) {
+    path.push_back('/');
+  }
+  path.append(name);
+  return path;
+}
+
+// 按相对或虚拟路径查找节点，不存在时返回 nullptr
+static Index::Node *find(Index::Node &root, std::string_view path) {
+  Index::Node *node = &root;
+  while (!path.empty()) {
+    size_t end = path.find('/');
+    std::string_view name = path.substr(0, end);
+    path.remove_prefix(end == std::string_view::npos ? path.size() : end + 1);
+    if (name.empty()) {
+      continue;
+    }
+    auto it = node->children.find(name);
+    if (it == node->children.end()) {
+      return nullptr;
+    }
+    node = &it->second;
+  }
+  return node;
+}
+
+// 移除 path 及其子目录上的监视，目录被移走后旧路径不再有效
+static void unwatch(int inotify_fd,
+                    std::unordered_map<int, std::string> &watches,
+                    const std::string &path) {
+  for (auto it = watches.begin(); it != watches.end();) {
+    if (it->second == path || it->second.starts_with(path + "/")) {
+      inotify_rm_watch(inotify_fd, it->first);
+      it = watches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool Index::reload() {
+  auto cfg = Config::get();
+  auto state = current.load();
+  if (!cfg->index) {
+    if (state != nullptr) {
+      current.store(nullptr);
+      eventfd_write(state->wake_fd, 1);
+      std::cout << "Index disabled" << std::endl;
+    }
+    return true;
+  }
+  if (state != nullptr && state->root_path == cfg->root_path) {
+    return true;
+  }
+  auto next = std::make_shared<State>();
+  next->root_path = cfg->root_path;
+  next->root_fd =
+      open(cfg->root_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  next->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  next->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (next->root_fd < 0 || next->inotify_fd < 0 || next->wake_fd < 0) {
+    std::cerr << "Failed to start index: " << strerror(errno) << std::endl;
+    return false;
+  }
+  next->root.dir = true;
+  // 旧索引的后台线程被唤醒后自行退出
+  if (state != nullptr) {
+    eventfd_write(state->wake_fd, 1);
+  }
+  current.store(next);
+  std::thread(&Index::run, std::move(next)).detach();
+  return true;
+}
+
+bool Index::ready() {
+  auto state = current.load();
+  return state != nullptr && state->ready;
+}
+
+// 先访问目录本身，再按名称递归子目录，与 ls -R 的输出顺序一致
+static void
+visit_tree(std::string &dir, const Index::Node &node,
+           const std::function<void(std::string_view, const Index::Node &)>
+               &visit) {
+  visit(dir, node);
+  for (auto &[name, child] : node.children) {
+    if (!child.dir) {
+      continue;
+    }
+    size_t length = dir.size();
+    if (!dir.empty()) {
+      dir.push_back('/');
+    }
+    dir.append(name);
+    visit_tree(dir, child, visit);
+    dir.resize(length);
+  }
+}
+
+bool Index::walk(
+    std::string_view path,
+    const std::function<void(std::string_view, const Node &)> &visit) {
+  auto state = current.load();
+  if (state == nullptr || !state->ready) {
+    return false;
+  }
+  std::shared_lock lock(state->mutex);
+  Node *node = find(state->root, path);
+  if (node == nullptr || !node->dir) {
+    return false;
+  }
+  std::string dir;
+  visit_tree(dir, *node, visit);
+  return true;
+}
+
+void Index::scan_dir(State &state, Job &job, std::vector<Job> &found) {
+  std::string watch_path = state.root_path + "/" + job.path;
+  int wd = inotify_add_watch(state.inotify_fd, watch_path.c_str(), WATCH_MASK);
+  if (wd >= 0) {
+    std::lock_guard<std::mutex> lock(state.watch_mutex);
+    state.watches[wd] = job.path;
+  } else {
+    // 通常是超出了 fs.inotify.max_user_watches，索引仍可用但该目录不再更新
+    std::cerr << "Failed to watch " << watch_path << ": " << strerror(errno)
+              << std::endl;
+  }
+  DIR *dir = fdopendir(job.fd);
+  if (dir == nullptr) {
+    close(job.fd);
+    return;
+  }
+  auto storage = Storage::get();
+  while (dirent *entry = readdir(dir)) {
+    std::string_view name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    struct stat status;
+    if (storage->stat_at(dirfd(dir), entry->d_name, status) < 0) {
+      continue;
+    }
+    Node &child = job.node->children[std::string(name)];
+    child.dir = S_ISDIR(status.st_mode);
+    child.size = S_ISREG(status.st_mode) ? status.st_size : 0;
+    child.mtime = status.st_mtime;
+    state.entries.fetch_add(1, std::memory_order_relaxed);
+    if (!child.dir) {
+      continue;
+    }
+    // 不跟随符号链接，与路径层一样不会越出根目录
+    int fd = openat(dirfd(dir), entry->d_name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) {
+      found.push_back({&child, join(job.path, name), fd});
+    }
+  }
+  closedir(dir);
+}
+
+void Index::scan(State &state, Node &node, const std::string &path, int fd,
+                 int threads) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<Job> jobs{{&node, path, fd}};
+  int active = 0; // 正在扫描的目录数
+  // 每个目录节点只由扫描它的线程修改，取出任务后无需加锁
+  auto worker = [&] {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      cv.wait(lock, [&] { return !jobs.empty() || active == 0; });
+      if (jobs.empty()) {
+        return;
+      }
+      Job job = std::move(jobs.back());
+      jobs.pop_back();
+      active++;
+      lock.unlock();
+      std::vector<Job> found;
+      scan_dir(state, job, found);
+      lock.lock();
+      active--;
+      for (auto &next : found) {
+        jobs.push_back(std::move(next));
+      }
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threads; i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+void Index::apply(State &state, const inotify_event &event) {
+  std::string dir;
+  {
+    std::lock_guard<std::mutex> lock(state.watch_mutex);
+    auto it = state.watches.find(event.wd);
+    if (it == state.watches.end()) {
+      return;
+    }
+    if (event.mask & IN_IGNORED) {
+      // 目录已删除，内核移除了监视
+      state.watches.erase(it);
+      return;
+    }
+    dir = it->second;
+  }
+  Node *parent = find(state.root, dir);
+  if (event.len == 0 || parent == nullptr) {
+    return;
+  }
+  std::string_view name = event.name;
+  std::string path = join(dir, name);
+  struct stat status;
+  int dir_fd = openat(state.root_fd, dir.empty() ? "." : dir.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  bool exists = dir_fd >= 0 && !(event.mask & (IN_DELETE | IN_MOVED_FROM)) &&
+                Storage::get()->stat_at(dir_fd, event.name, status) == 0;
+  auto it = parent->children.find(name);
+  if (!exists) {
+    if (dir_fd >= 0) {
+      close(dir_fd);
+    }
+    if (it == parent->children.end()) {
+      return;
+    }
+    if (it->second.dir) {
+      std::lock_guard<std::mutex> lock(state.watch_mutex);
+      unwatch(state.inotify_fd, state.watches, path);
+    }
+    // 摘下的子树在锁外释放
+    decltype(parent->children)::node_type removed;
+    std::unique_lock lock(state.mutex);
+    removed = parent->children.extract(it);
+    return;
+  }
+  bool was_dir = it != parent->children.end() && it->second.dir;
+  Node scanned;
+  if (S_ISDIR(status.st_mode) && !was_dir) {
+    // 新建或移入的目录，其中可能已有内容，先扫描到独立的节点中
+    int fd = openat(dir_fd, event.name,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) {
+      scan(state, scanned, path, fd, 1);
+    }
+  }
+  close(dir_fd);
+  std::unique_lock lock(state.mutex);
+  Node &child = parent->children[std::string(name)];
+  child.dir = S_ISDIR(status.st_mode);
+  child.size = S_ISREG(status.st_mode) ? status.st_size : 0;
+  child.mtime = status.st_mtime;
+  if (child.dir != was_dir) {
+    // 旧的子项与 scanned 交换后在锁外释放
+    child.children.swap(scanned.children);
+  }
+}
+
+void Index::run(std::shared_ptr<State> state) {
+  int threads = Config::get()->index_threads;
+  // 扫描到新的路径树后再替换，扫描期间查询仍使用旧的路径树
+  auto rebuild = [&] {
+    auto start = std::chrono::steady_clock::now();
+    state->entries = 0;
+    {
+      std::lock_guard<std::mutex> lock(state->watch_mutex);
+      for (auto &[wd, path] : state->watches) {
+        inotify_rm_watch(state->inotify_fd, wd);
+      }
+      state->watches.clear();
+    }
+    Node root;
+    root.dir = true;
+    int fd = openat(state->root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+      scan(*state, root, "", fd, threads);
+    }
+    {
+      std::unique_lock lock(state->mutex);
+      state->root.children.swap(root.children);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    std::cout << "Index built: " << state->entries << " entries in "
+              << elapsed.count() << " ms" << std::endl;
+  };
+  // 初次扫描期间的变化暂存在 inotify 队列中，完成后再应用
+  rebuild();
+  state->ready = true;
+  alignas(inotify_event) char buffer[64 * 1024];
+  while (true) {
+    pollfd fds[2] = {{state->inotify_fd, POLLIN, 0},
+                     {state->wake_fd, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+    ssize_t n = read(state->inotify_fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+      continue;
+    }
+    for (char *p = buffer; p < buffer + n;) {
+      auto *event = reinterpret_cast<inotify_event *>(p);
+      p += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // 事件丢失，只能重新扫描
+        std::cerr << "Index event queue overflowed, rescanning" << std::endl;
+        rebuild();
+        break;
+      }
+      apply(*state, *event);
+    }
+  }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/inotify.h>
+#include <vector>
+
+namespace ftp {
+
+// 内存中的命名空间索引
+// 启动时多线程并行扫描根目录建立路径树，之后经 inotify 跟踪变化；
+// SITE FIND 与 LIST -R 直接查询内存，不再逐级访问磁盘
+class Index {
+public:
+  // 路径树中的一个文件或目录，每级路径一个节点
+  struct Node {
+    bool dir = false;  // 是否为目录
+    uint64_t size = 0; // 文件大小，与 LIST 显示的一致
+    time_t mtime = 0;  // 修改时间
+    std::map<std::string, Node, std::less<>> children; // 子项，按名称排序
+  };
+
+  // 按配置启动或停止索引，根目录变化时重新建立
+  static bool reload();
+  // 初次扫描是否已完成
+  static bool ready();
+  // 遍历规范化虚拟路径 path 下的所有目录：先访问目录本身，再按名称递归子目录
+  // 回调收到相对 path 的目录路径（path 本身为空串）与目录节点，期间索引不会变化
+  // 索引未就绪或 path 不是目录时返回 false
+  static bool
+  walk(std::string_view path,
+       const std::function<void(std::string_view, const Node &)> &visit);
+
+private:
+  Index() = default;
+  ~Index() = default;
+  Index(const Index &) = delete;
+  Index(Index &&) = delete;
+  Index &operator=(const Index &) = delete;
+  Index &operator=(Index &&) = delete;
+
+  struct State;
+  struct Job;
+
+  // 后台线程：建立索引后处理 inotify 事件，直到被停止
+  static void run(std::shared_ptr<State> state);
+  // 从 fd 对应的目录开始扫描整棵子树，threads 个线程并行
+  static void scan(State &state, Node &node, const std::string &path, int fd,
+                   int threads);
+  // 读取一个目录的子项，子目录加入 found 等待扫描
+  static void scan_dir(State &state, Job &job, std::vector<Job> &found);
+  // 按一个 inotify 事件更新路径树，磁盘访问不持锁，修改时短暂持有写锁
+  static void apply(State &state, const inotify_event &event);
+
+private:
+  // 当前索引，停止时为空
+  static std::atomic<std::shared_ptr<State>> current;
+};
+
+} // namespace ftp
@@ -1,9 +1,63 @@
+#include "config.hpp"
+#include "index.hpp"
+#include "path.hpp"
+#include "recorder.hpp"
 #include "server.hpp"
+#include "storage.hpp"
+#include "tls.hpp"
+#include "user.hpp"
+#include <csignal>
+#include <iostream>
 using namespace ftp;
 
-int main() {
+int main(int argc, char *argv[]) {
+  // 对端断开后继续写入（包括 TLS 的 close_notify）只返回错误，不终止进程
+  signal(SIGPIPE, SIG_IGN);
+  // 屏蔽 SIGHUP 与 SIGUSR1，分别由配置监听线程与飞行记录器线程处理
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGHUP);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+  // Load the runtime configuration
+  // 参数 --upgrade 表示从正在运行的旧进程接管监听套接字
+  std::string config_path = "ftp.conf";
+  bool upgrade = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--hash-password" && i + 1 < argc) {
+      // 生成口令摘要，写入帐号文件或配置文件 [users] 段
+      std::cout << User::hash_password(argv[i + 1]) << std::endl;
+      return 0;
+    }
+    if (std::string(argv[i]) == "--upgrade") {
+      upgrade = true;
+    } else {
+      config_path = argv[i];
+    }
+  }
+  if (!Config::load(config_path)) {
+    std::cerr << "Using default configuration" << std::endl;
+  }
+  if (!Path::reload() || !Storage::reload() || !User::reload()) {
+    return SERVER_INNER_ERROR;
+  }
+  Recorder::init(Config::get()->recorder_size);
+  Recorder::watch();
+  Tls::reload();
+  Index::reload();
+  Config::on_reload(&Path::reload);
+  Config::on_reload(&User::reload);
+  Config::on_reload(&Tls::reload);
+  Config::on_reload(&Index::reload);
+  Config::watch();
+
   // Start the FTP server
-  FtpServer::start();
+  // 返回时会话与事件循环均已结束，再停止认证与缓存填充线程，
+  // 之后才能释放静态对象
+  FtpServer::start(upgrade);
+  User::stop();
+  Storage::get()->stop();
 
   return 0;
 }
\ No newline at end of file
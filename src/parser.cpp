@@ -1,76 +1,108 @@
 #include "parser.hpp"
+#include <algorithm>
+#include <cctype>
 #include <iostream>
 using namespace ftp;
-Command Parser::parse(std::string &command) {
-  std::cout << "Parsing command: " << command.substr(0, 4) << std::endl;
-  std::cout << "Command: " << command.substr(5) << std::endl;
+Command Parser::parse(std::pmr::string &command) {
+  std::string_view view = command;
+  std::cout << "Parsing command: " << view.substr(0, 4) << std::endl;
+  std::cout << "Command: " << view.substr(std::min<size_t>(5, view.size()))
+            << std::endl;
   if (!is_valid_command(command)) {
     return Command::ERROR;
   }
   Upper(command);
-  if (command.substr(0, 4) == "USER") {
+  if (view.substr(0, 4) == "USER") {
     trim_ftp_command(command);
     return Command::USER;
-  } else if (command.substr(0, 4) == "PASS") {
+  } else if (view.substr(0, 4) == "PASS") {
     trim_ftp_command(command);
     return Command::PASS;
-  } else if (command.substr(0, 4) == "LIST") {
+  } else if (view.substr(0, 4) == "LIST") {
     trim_ftp_command(command);
     return Command::LIST;
-  } else if (command.substr(0, 4) == "QUIT") {
+  } else if (view.substr(0, 4) == "QUIT") {
     trim_ftp_command(command);
     return Command::QUIT;
-  } else if (command.substr(0, 4) == "RETR") {
+  } else if (view.substr(0, 4) == "RETR") {
     trim_ftp_command(command);
     return Command::RETR;
-  } else if (command.substr(0, 3) == "GET") {
+  } else if (view.substr(0, 4) == "STOR") {
+    trim_ftp_command(command);
+    return Command::STOR;
+  } else if (view.substr(0, 3) == "GET") {
     trim_ftp_command(command);
     return Command::GET;
-  } else if (command.substr(0, 3) == "PWD") {
+  } else if (view.substr(0, 3) == "PWD") {
     trim_ftp_command(command);
     return Command::PWD;
-  } else if (command.substr(0, 4) == "EPSV") {
+  } else if (view.substr(0, 4) == "EPSV") {
     trim_ftp_command(command);
     return Command::EPSV;
-  } else if (command.substr(0, 4) == "PASV") {
+  } else if (view.substr(0, 4) == "PASV") {
     trim_ftp_command(command);
     return Command::PASV;
-  } else if (command.substr(0, 3) == "LCD") {
+  } else if (view.substr(0, 3) == "CWD") {
+    trim_ftp_command(command);
+    return Command::CWD;
+  } else if (view.substr(0, 4) == "CDUP") {
+    trim_ftp_command(command);
+    return Command::CDUP;
+  } else if (view.substr(0, 3) == "LCD") {
     trim_ftp_command(command);
     return Command::LCD;
-  } else if (command.substr(0, 4) == "SYST") {
+  } else if (view.substr(0, 4) == "SYST") {
     trim_ftp_command(command);
     return Command::SYST;
-  } else if (command.substr(0, 4) == "TYPE") {
+  } else if (view.substr(0, 4) == "TYPE") {
     trim_ftp_command(command);
     return Command::TYPE;
-  } else if (command.substr(0, 4) == "PORT") {
+  } else if (view.substr(0, 4) == "PORT") {
     trim_ftp_command(command);
     return Command::PORT;
+  } else if (view.substr(0, 4) == "AUTH") {
+    trim_ftp_command(command);
+    return Command::AUTH;
+  } else if (view.substr(0, 4) == "PBSZ") {
+    trim_ftp_command(command);
+    return Command::PBSZ;
+  } else if (view.substr(0, 4) == "PROT") {
+    trim_ftp_command(command);
+    return Command::PROT;
+  } else if (view.substr(0, 4) == "SITE") {
+    trim_ftp_command(command);
+    return Command::SITE;
+  } else if (view.substr(0, 4) == "MODE") {
+    trim_ftp_command(command);
+    return Command::MODE;
+  } else if (view.substr(0, 4) == "REST") {
+    trim_ftp_command(command);
+    return Command::REST;
   }
   std::cout << "Unknown command: " << command << std::endl;
   return Command::ERROR;
 }
 
-void Parser::trim_ftp_command(std::string &str) {
+void Parser::trim_ftp_command(std::pmr::string &str) {
   // 移除末尾的 \r\n
   while (!str.empty() && (str.back() == '\r' || str.back() == '\n')) {
     str.pop_back();
   }
   if (str.size() < 4) {
-    str = "";
+    str.clear();
     return;
   }
+  // 原地截取参数，避免重新分配
   for (int i = 0; i < str.size(); i++) {
     if (str[i] == ' ') {
-      str = str.substr(i + 1);
+      str.erase(0, i + 1);
       return;
     }
   }
-  str = "";
+  str.clear();
 }
 
-void Parser::Upper(std::string &str) {
+void Parser::Upper(std::pmr::string &str) {
   for (int i = 0; i < str.size(); i++) {
     if (str[i] >= 'a' && str[i] <= 'z') {
       str[i] -= 32;
@@ -80,21 +112,17 @@ void Parser::Upper(std::string &str) {
   }
 }
 
-bool Parser::is_valid_command(const std::string &command) {
-  // 检查命令是否合法
-  if (command.empty()) {
-    return false;
+bool Parser::is_valid_command(std::string_view command) {
+  // 命令名为 3 到 4 个字母，参数中可以有空格（文件名、SITE 子命令等）
+  size_t verb = command.find_first_of(" \r\n");
+  if (verb == std::string_view::npos) {
+    verb = command.size();
   }
-  int space_count = 0;
-  for (char c : command) {
-    if (c == ' ') {
-      space_count++;
-      if (space_count > 1) {
-        return false; // 只允许一个空格
-      }
-    }
+  if (verb < 3 || verb > 4) {
+    return false;
   }
-  return true;
+  return std::all_of(command.begin(), command.begin() + verb,
+                     [](char c) { return std::isalpha((unsigned char)c); });
 }
 
 std::pair<std::string, int> Parser::parse_path(std::string_view ip) {
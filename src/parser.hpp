@@ -1,12 +1,13 @@
 #pragma once
 #include "define.hpp"
 #include <string>
+#include <string_view>
 
 namespace ftp {
 
 class Parser {
 public:
-  static Command parse(std::string &command);
+  static Command parse(std::pmr::string &command);
   static std::pair<std::string, int> parse_path(std::string_view ip);
 
 private:
@@ -16,9 +17,9 @@ private:
   Parser(Parser &&) = delete;
   Parser &operator=(const Parser &) = delete;
   Parser &operator=(Parser &&) = delete;
-  static void trim_ftp_command(std::string &str);
-  static void Upper(std::string &str);
-  static bool is_valid_command(const std::string &command);
+  static void trim_ftp_command(std::pmr::string &str);
+  static void Upper(std::pmr::string &str);
+  static bool is_valid_command(std::string_view command);
 };
 
 } // namespace ftp
\ No newline at end of file
@@ -0,0 +1,287 @@
+#include "path.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace ftp;
+
+inline std::atomic<std::shared_ptr<DirHandle>> Path::root_dir;
+// 当前根目录的路径
+inline std::string Path::root_path;
+// 目录句柄缓存，表头为最近使用
+inline Path::LruList Path::lru;
+// 虚拟路径 与 缓存节点的映射
+inline std::unordered_map<std::string, Path::LruList::iterator, StringHash,
+                          std::equal_to<>>
+    Path::dirs;
+// 保护 root_path、lru 与 dirs 的互斥锁
+inline std::mutex Path::dirs_mutex;
+
+DirHandle::DirHandle(int fd) : fd_(fd) {
+  struct stat st;
+  if (fstat(fd_, &st) == 0) {
+    dev_ = st.st_dev;
+    ino_ = st.st_ino;
+  }
+}
+
+DirHandle::~DirHandle() { close(fd_); }
+
+bool Path::reload() {
+  auto cfg = Config::get();
+  std::lock_guard<std::mutex> lock(dirs_mutex);
+  if (root_dir.load() != nullptr && root_path == cfg->root_path) {
+    return true;
+  }
+  int fd = ::open(cfg->root_path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Failed to open root path " << cfg->root_path << ": "
+              << strerror(errno) << std::endl;
+    return false;
+  }
+  // 已建立的会话继续持有旧根目录下的句柄，新会话使用新根目录
+  root_path = cfg->root_path;
+  root_dir.store(std::make_shared<DirHandle>(fd));
+  dirs.clear();
+  lru.clear();
+  return true;
+}
+
+std::shared_ptr<DirHandle> Path::root() { return root_dir.load(); }
+
+void Path::normalize(std::string_view cwd, std::string_view path,
+                     std::pmr::string &out) {
+  auto append = [&out](std::string_view part) {
+    while (!part.empty()) {
+      auto pos = part.find('/');
+      auto name = part.substr(0, pos);
+      part.remove_prefix(pos == std::string_view::npos ? part.size()
+                                                       : pos + 1);
+      if (name.empty() || name == ".") {
+        continue;
+      }
+      if (name == "..") {
+        // 在根目录时停留在根目录
+        auto slash = out.rfind('/');
+        out.resize(slash == std::string::npos ? 0 : slash);
+        continue;
+      }
+      out.append("/").append(name);
+    }
+  };
+  out.clear();
+  if (path.empty() || path.front() != '/') {
+    append(cwd);
+  }
+  append(path);
+  if (out.empty()) {
+    out.append("/");
+  }
+}
+
+int Path::open_beneath(int dir_fd, const char *path, int flags, mode_t mode) {
+  open_how how{};
+  how.flags = flags | O_CLOEXEC;
+  how.mode = mode;
+  how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+  return syscall(SYS_openat2, dir_fd, path, &how, sizeof(how));
+}
+
+// 去掉虚拟路径开头的 /，复制为以 0 结尾的相对路径，过长时设置 errno
+static bool relative(std::string_view path, char (&out)[PATH_MAX]) {
+  auto start = path.find_first_not_of('/');
+  path.remove_prefix(start == std::string_view::npos ? path.size() : start);
+  if (path.size() >= PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  *std::copy(path.begin(), path.end(), out) = '\0';
+  return true;
+}
+
+std::shared_ptr<DirHandle> Path::open_dir(std::string_view path) {
+  auto root = root_dir.load();
+  if (path == "/") {
+    return root;
+  }
+  // 找到缓存中最近的祖先目录，只需查找剩余部分
+  std::shared_ptr<DirHandle> base = root;
+  std::string_view prefix = path;
+  {
+    std::lock_guard<std::mutex> lock(dirs_mutex);
+    while (!prefix.empty()) {
+      auto it = dirs.find(prefix);
+      if (it != dirs.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        if (prefix.size() == path.size()) {
+          return it->second->second;
+        }
+        base = it->second->second;
+        break;
+      }
+      prefix = prefix.substr(0, prefix.rfind('/'));
+    }
+  }
+  if (base == root) {
+    return reopen_dir(path);
+  }
+  char rest[PATH_MAX];
+  if (!relative(path.substr(prefix.size()), rest)) {
+    return nullptr;
+  }
+  int fd = open_beneath(base->fd(), rest, O_PATH | O_DIRECTORY);
+  if (fd < 0) {
+    // 缓存的祖先目录可能已被改名或删除，移出缓存后从根目录重新查找
+    evict(prefix, base);
+    return reopen_dir(path);
+  }
+  return store(path, std::make_shared<DirHandle>(fd), root);
+}
+
+std::shared_ptr<DirHandle> Path::reopen_dir(std::string_view path) {
+  auto root = root_dir.load();
+  if (path == "/") {
+    return root;
+  }
+  char rest[PATH_MAX];
+  if (!relative(path, rest)) {
+    return nullptr;
+  }
+  int fd = open_beneath(root->fd(), rest, O_PATH | O_DIRECTORY);
+  if (fd < 0) {
+    int error = errno;
+    evict(path, nullptr);
+    errno = error;
+    return nullptr;
+  }
+  // 缓存中的句柄仍指向同一目录时沿用，不再新建
+  struct stat dir_stat;
+  if (fstat(fd, &dir_stat) == 0) {
+    std::shared_ptr<DirHandle> cached;
+    {
+      std::lock_guard<std::mutex> lock(dirs_mutex);
+      auto it = dirs.find(path);
+      if (it != dirs.end() && it->second->second->same(dir_stat)) {
+        lru.splice(lru.begin(), lru, it->second);
+        cached = it->second->second;
+      }
+    }
+    if (cached != nullptr) {
+      close(fd);
+      return cached;
+    }
+  }
+  return store(path, std::make_shared<DirHandle>(fd), root);
+}
+
+std::shared_ptr<DirHandle> Path::store(std::string_view path,
+                                       std::shared_ptr<DirHandle> dir,
+                                       const std::shared_ptr<DirHandle> &root) {
+  std::lock_guard<std::mutex> lock(dirs_mutex);
+  // 期间根目录已切换时不缓存旧根目录下的句柄
+  if (root_dir.load() != root) {
+    return dir;
+  }
+  auto it = dirs.find(path);
+  if (it != dirs.end()) {
+    // 替换失效的句柄，仍在使用旧句柄的会话不受影响
+    it->second->second = dir;
+    lru.splice(lru.begin(), lru, it->second);
+    return dir;
+  }
+  lru.emplace_front(std::string(path), dir);
+  dirs.emplace(lru.front().first, lru.begin());
+  size_t capacity = std::max(1, Config::get()->dir_cache_size);
+  while (lru.size() > capacity) {
+    dirs.erase(lru.back().first);
+    lru.pop_back();
+  }
+  return dir;
+}
+
+void Path::evict(std::string_view path, const std::shared_ptr<DirHandle> &dir) {
+  std::lock_guard<std::mutex> lock(dirs_mutex);
+  auto it = dirs.find(path);
+  if (it != dirs.end() && (dir == nullptr || it->second->second == dir)) {
+    lru.erase(it->second);
+    dirs.erase(it);
+  }
+}
+
+int Path::retry(std::string_view dir_path,
+                const std::shared_ptr<DirHandle> &dir, const char *name,
+                int flags) {
+  int error = errno;
+  auto fresh = reopen_dir(dir_path);
+  if (fresh == nullptr || fresh->same(*dir)) {
+    errno = error;
+    return -1;
+  }
+  return open_beneath(fresh->fd(), name, flags);
+}
+
+int Path::open(const Client &session, std::string_view path, int flags) {
+  std::pmr::string name(session.arena);
+  bool simple = !path.empty() && path.front() != '/';
+  for (std::string_view rest = path; simple && !rest.empty();) {
+    auto pos = rest.find('/');
+    simple = rest.substr(0, pos) != "..";
+    rest.remove_prefix(pos == std::string_view::npos ? rest.size() : pos + 1);
+  }
+  if (path.empty() || simple) {
+    // 相对当前目录一次查找
+    name.append(path.empty() ? "." : path);
+    int fd = open_beneath(session.cwd->fd(), name.c_str(), flags);
+    if (fd >= 0 || session.curr_path == "/") {
+      return fd;
+    }
+    // 查找失败时核对当前目录是否已被改名或删除，是则相对新的目录重试
+    return retry(session.curr_path, session.cwd, name.c_str(), flags);
+  }
+  std::pmr::string full(session.arena);
+  normalize(session.curr_path, path, full);
+  if (full == "/") {
+    return open_beneath(root_dir.load()->fd(), ".", flags);
+  }
+  auto pos = full.rfind('/');
+  auto parent_path = pos == 0 ? std::string_view("/")
+                              : std::string_view(full).substr(0, pos);
+  auto parent = open_dir(parent_path);
+  if (parent == nullptr) {
+    return -1;
+  }
+  name.append(std::string_view(full).substr(pos + 1));
+  int fd = open_beneath(parent->fd(), name.c_str(), flags);
+  if (fd >= 0 || parent_path == "/") {
+    return fd;
+  }
+  return retry(parent_path, parent, name.c_str(), flags);
+}
+
+std::shared_ptr<DirHandle> Path::open_parent(const Client &session,
+                                             std::string_view path,
+                                             std::pmr::string &name) {
+  // 当前目录下的文件名直接使用会话的目录句柄
+  if (!path.empty() && path.find('/') == std::string_view::npos &&
+      path != "." && path != "..") {
+    name.assign(path);
+    return session.cwd;
+  }
+  std::pmr::string full(session.arena);
+  normalize(session.curr_path, path, full);
+  if (full == "/") {
+    errno = EISDIR;
+    return nullptr;
+  }
+  auto pos = full.rfind('/');
+  name.assign(std::string_view(full).substr(pos + 1));
+  return open_dir(pos == 0 ? std::string_view("/")
+                           : std::string_view(full).substr(0, pos));
+}
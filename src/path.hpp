@@ -0,0 +1,109 @@
+#pragma once
+#include "define.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ftp {
+
+// 已打开的目录（O_PATH），最后一个持有者释放时关闭
+// 记录打开时的设备号与 inode，用于判断路径是否仍指向同一目录
+class DirHandle {
+public:
+  explicit DirHandle(int fd);
+  ~DirHandle();
+  DirHandle(const DirHandle &) = delete;
+  DirHandle(DirHandle &&) = delete;
+  DirHandle &operator=(const DirHandle &) = delete;
+  DirHandle &operator=(DirHandle &&) = delete;
+
+  int fd() const { return fd_; }
+  // 是否与 stat 结果或另一个句柄是同一目录
+  bool same(const struct stat &st) const {
+    return st.st_dev == dev_ && st.st_ino == ino_;
+  }
+  bool same(const DirHandle &other) const {
+    return other.dev_ == dev_ && other.ino_ == ino_;
+  }
+
+private:
+  int fd_;
+  dev_t dev_ = 0;
+  ino_t ino_ = 0;
+};
+
+// 沙箱化的路径层
+// 会话持有当前目录的句柄，所有查找都经 openat2(RESOLVE_BENEATH) 相对完成，
+// 无法越出根目录；打开过的目录缓存在全局 LRU 中，供各会话共享。
+// CWD 总是从根目录重新查找；经缓存句柄的查找失败时，说明目录可能已被
+// 改名或删除，从根目录重新查找后重试一次并刷新缓存
+class Path {
+public:
+  // 打开 root_path，根目录变化时清空缓存，失败时保留旧的根目录
+  static bool reload();
+  // 根目录句柄
+  static std::shared_ptr<DirHandle> root();
+  // 把参数合并到当前虚拟路径并规范化，结果以 / 开头，.. 不会越过根目录
+  static void normalize(std::string_view cwd, std::string_view path,
+                        std::pmr::string &out);
+  // 打开规范化后的虚拟路径对应的目录，失败返回 nullptr 并设置 errno
+  static std::shared_ptr<DirHandle> open_dir(std::string_view path);
+  // 从根目录重新查找目录并刷新缓存，用于 CWD 与查找失败后的核对
+  static std::shared_ptr<DirHandle> reopen_dir(std::string_view path);
+  // 相对会话当前目录打开路径，失败返回 -1 并设置 errno
+  // 简单相对路径只需一次查找，含 .. 或绝对路径时相对缓存中的父目录查找
+  static int open(const Client &session, std::string_view path, int flags);
+  // 打开路径的父目录，name 返回最后一级名称，用于创建或替换文件
+  static std::shared_ptr<DirHandle>
+  open_parent(const Client &session, std::string_view path,
+              std::pmr::string &name);
+  // openat2(RESOLVE_BENEATH)，path 不能越出 dir_fd
+  static int open_beneath(int dir_fd, const char *path, int flags,
+                          mode_t mode = 0);
+
+private:
+  Path() = default;
+  ~Path() = default;
+  Path(const Path &) = delete;
+  Path(Path &&) = delete;
+  Path &operator=(const Path &) = delete;
+  Path &operator=(Path &&) = delete;
+
+  using LruList =
+      std::list<std::pair<std::string, std::shared_ptr<DirHandle>>>;
+
+  // 缓存 path 对应的句柄，返回应使用的句柄
+  static std::shared_ptr<DirHandle>
+  store(std::string_view path, std::shared_ptr<DirHandle> dir,
+        const std::shared_ptr<DirHandle> &root);
+  // 移出 path 的缓存，dir 不为空时只在仍是该句柄时移出
+  static void evict(std::string_view path,
+                    const std::shared_ptr<DirHandle> &dir);
+  // 经 dir 查找 name 失败后，从根目录重新打开 dir_path，目录已变化时重试
+  static int retry(std::string_view dir_path,
+                   const std::shared_ptr<DirHandle> &dir, const char *name,
+                   int flags);
+
+private:
+  // 根目录
+  static std::atomic<std::shared_ptr<DirHandle>> root_dir;
+  // 当前根目录的路径
+  static std::string root_path;
+  // 目录句柄缓存，表头为最近使用
+  static LruList lru;
+  // 虚拟路径 与 缓存节点的映射
+  static std::unordered_map<std::string, LruList::iterator, StringHash,
+                            std::equal_to<>>
+      dirs;
+  // 保护 root_path、lru 与 dirs 的互斥锁
+  static std::mutex dirs_mutex;
+};
+
+} // namespace ftp
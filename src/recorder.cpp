@@ -0,0 +1,195 @@
+#include "recorder.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+using namespace ftp;
+
+// 每个槽位是一个顺序锁：0 为空，写入期间为奇数，写完为 2 * (序号 + 1)
+// 读者在复制前后各读一次，不一致或不是期望的序号时丢弃该条
+struct Recorder::Slot {
+  std::atomic<uint64_t> seq = 0;
+  Record record;
+};
+
+// 环形缓冲区
+inline std::unique_ptr<Recorder::Slot[]> Recorder::slots;
+// 容量减一，容量为 2 的幂
+inline size_t Recorder::mask = 0;
+// 下一条记录的序号
+inline std::atomic<uint64_t> Recorder::head = 0;
+
+static int64_t clock_ns(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void Recorder::init(size_t size) {
+  if (size == 0) {
+    return;
+  }
+  size = std::bit_ceil(size);
+  slots = std::make_unique<Slot[]>(size);
+  mask = size - 1;
+}
+
+int64_t Recorder::now() { return clock_ns(CLOCK_MONOTONIC); }
+
+void Recorder::push(const Record &record) {
+  uint64_t ticket = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[ticket & mask];
+  slot.seq.store(ticket * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(&slot.record, &record, sizeof(record));
+  slot.seq.store(ticket * 2 + 2, std::memory_order_release);
+}
+
+std::string Recorder::dump() {
+  FileHeader header{};
+  std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+  header.record_size = sizeof(Record);
+  header.dumped = clock_ns(CLOCK_REALTIME);
+  std::string out(sizeof(header), '\0');
+  uint64_t end = head.load(std::memory_order_acquire);
+  header.written = end;
+  if (slots != nullptr) {
+    uint64_t begin = end > mask + 1 ? end - mask - 1 : 0;
+    out.reserve(sizeof(header) + (end - begin) * sizeof(Record));
+    Record record;
+    for (uint64_t ticket = begin; ticket < end; ticket++) {
+      Slot &slot = slots[ticket & mask];
+      uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != ticket * 2 + 2) {
+        continue;
+      }
+      std::memcpy(&record, &slot.record, sizeof(record));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) != seq) {
+        continue;
+      }
+      out.append(reinterpret_cast<const char *>(&record), sizeof(record));
+      header.count++;
+    }
+  }
+  std::memcpy(out.data(), &header, sizeof(header));
+  return out;
+}
+
+bool Recorder::dump(const std::string &path) {
+  std::string data = dump();
+  std::string temp = path + ".tmp";
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close(fd);
+      unlink(temp.c_str());
+      return false;
+    }
+    written += n;
+  }
+  close(fd);
+  return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+void Recorder::watch() {
+  auto watcher = std::thread([] {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while (true) {
+      int sig = 0;
+      if (sigwait(&set, &sig) != 0) {
+        continue;
+      }
+      std::string path = Config::get()->recorder_path;
+      if (dump(path)) {
+        std::cout << "Flight recorder dumped to " << path << std::endl;
+      } else {
+        std::cerr << "Failed to dump flight recorder to " << path << ": "
+                  << strerror(errno) << std::endl;
+      }
+    }
+  });
+  watcher.detach();
+}
+
+void Recorder::Trace::begin(uint64_t session, std::string_view line) {
+  record = Record{};
+  std::fill(std::begin(record.phases), std::end(record.phases), NONE);
+  record.start = clock_ns(CLOCK_REALTIME);
+  record.session = session;
+  base = now();
+  active = slots != nullptr;
+  while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) {
+    line.remove_suffix(1);
+  }
+  size_t space = line.find(' ');
+  std::string_view verb = line.substr(0, std::min(space, sizeof(record.verb)));
+  for (size_t i = 0; i < verb.size(); i++) {
+    record.verb[i] = std::toupper(static_cast<unsigned char>(verb[i]));
+  }
+  // 口令不进入记录
+  if (space == std::string_view::npos ||
+      std::string_view(record.verb, sizeof(record.verb)) == "PASS") {
+    return;
+  }
+  std::string_view arg = line.substr(space + 1);
+  std::memcpy(record.arg, arg.data(), std::min(arg.size(), sizeof(record.arg)));
+}
+
+void Recorder::Trace::mark(Phase phase) { mark(phase, now()); }
+
+void Recorder::Trace::mark(Phase phase, int64_t mono) {
+  if (!active) {
+    return;
+  }
+  int64_t micros = (mono - base) / 1000;
+  record.phases[phase] = static_cast<int32_t>(
+      std::clamp<int64_t>(micros, NONE + 1, INT32_MAX));
+}
+
+void Recorder::Trace::fail(int error) {
+  if (active && record.error == 0) {
+    record.error = error;
+  }
+}
+
+void Recorder::Trace::reply(std::string_view message) {
+  if (!active) {
+    return;
+  }
+  uint16_t code = 0;
+  for (size_t i = 0; i < 3 && i < message.size() &&
+                     std::isdigit(static_cast<unsigned char>(message[i]));
+       i++) {
+    code = code * 10 + (message[i] - '0');
+  }
+  record.reply = code;
+  mark(REPLIED);
+}
+
+void Recorder::Trace::end() {
+  if (!active) {
+    return;
+  }
+  push(record);
+  active = false;
+}
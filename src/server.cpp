@@ -1,32 +1,124 @@
 #include "server.hpp"
-#include "configs.hpp"
+#include "archive.hpp"
+#include "buffer.hpp"
+#include "config.hpp"
+#include "dedup.hpp"
+#include "executor.hpp"
+#include "index.hpp"
 #include "parser.hpp"
+#include "path.hpp"
+#include "tls.hpp"
+#include "tuning.hpp"
+#include "upgrade.hpp"
+#include "user.hpp"
+#include <algorithm>
 #include <arpa/inet.h>
+#include <charconv>
 #include <cstring>
-#include <filesystem>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 #include <format>
-#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <thread>
 #include <unistd.h>
 
 using namespace ftp;
 
-inline std::unordered_map<std::string, std::string> FtpServer::users;
+// 每处理这么多条命令让出一次事件循环
+static constexpr size_t YIELD_INTERVAL = 64;
+// 强制关闭连接后等待会话退出的时间
+static constexpr auto CLOSE_TIMEOUT = std::chrono::seconds(5);
+
+inline std::unordered_map<std::string, std::string, StringHash, std::equal_to<>>
+    FtpServer::users;
 // 保护 users 的互斥锁
 inline std::mutex FtpServer::users_mutex;
-// IP 与 客户端信息的映射
-inline std::unordered_map<std::string, Client> FtpServer::clients;
+// 会话标识与 客户端信息的映射
+inline std::unordered_map<std::string, Client, StringHash, std::equal_to<>>
+    FtpServer::clients;
 // 保护 clients 的互斥锁
 inline std::mutex FtpServer::clients_mutex;
 // 登陆状态
-inline std::unordered_map<std::string, bool> FtpServer::login_status;
+inline std::unordered_map<std::string, bool, StringHash, std::equal_to<>>
+    FtpServer::login_status;
 // 保护 login_status 的互斥锁
 inline std::mutex FtpServer::login_status_mutex;
+// 当前会话数
+inline std::atomic<int> FtpServer::active_sessions = 0;
+// 上一个分配的会话编号
+inline std::atomic<uint64_t> FtpServer::last_session = 0;
+// 是否已交出监听套接字
+inline std::atomic<bool> FtpServer::draining = false;
+// 唤醒 accept 循环的管道
+inline int FtpServer::wake_fds[2] = {-1, -1};
 
-void FtpServer::start() {
+void FtpServer::start(bool upgrade) {
+  auto cfg = Config::get();
+  // 热升级时从旧进程接收监听套接字，失败则自行绑定
+  int server_fd = -1;
+  if (upgrade) {
+    server_fd = Upgrade::receive(cfg->upgrade_socket);
+  }
+  if (server_fd < 0) {
+    server_fd = create_listener();
+  }
+  // 监听套接字与新进程共享，对方可能先取走连接，accept 不能阻塞
+  fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+  if (pipe(wake_fds) < 0) {
+    std::cerr << "Failed to create wake pipe" << std::endl;
+    exit(SERVER_INNER_ERROR);
+  }
+  // 等待后续的新进程来接管监听套接字
+  Upgrade::serve(cfg->upgrade_socket, server_fd, [] {
+    draining = true;
+    char c = 0;
+    write(wake_fds[1], &c, 1);
+  });
+  std::cout << "FTP server started on port " << cfg->port << std::endl;
+  pollfd fds[2] = {{server_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}};
+  while (!draining) {
+    if (poll(fds, 2, -1) < 0 || !(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    // 交接完成后新连接都留给新进程
+    if (draining) {
+      break;
+    }
+    sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+    // 控制连接非阻塞，应答经事件循环发送
+    int client_fd = accept4(server_fd, (struct sockaddr *)&client_addr,
+                            &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0) {
+      // 连接已被新进程取走时回到 poll
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::cerr << "Accept failed: " << strerror(errno) << std::endl;
+      }
+      continue;
+    }
+    serve(client_addr, client_fd);
+  }
+  // 监听套接字已交给新进程，关闭本进程持有的副本后等待会话结束
+  close(server_fd);
+  drain(cfg->drain_timeout);
+}
+
+void FtpServer::serve(const sockaddr_in &address, int client_fd) {
+  Executor::spawn(handle_client(address, client_fd));
+}
+
+int FtpServer::create_listener() {
+  auto cfg = Config::get();
   // 创建一个服务器套接字
   // AF_INET 表示 IPv4，SOCK_STREAM 表示 TCP
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -34,525 +126,1013 @@ void FtpServer::start() {
     std::cerr << "Failed to create socket" << std::endl;
     exit(CREATE_SOCKET_ERROR);
   }
+  // 允许重启后立即复用端口
+  int reuse = 1;
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
   // 储存服务器地址信息
   sockaddr_in server_addr;
   server_addr.sin_family = AF_INET;
   server_addr.sin_addr.s_addr = INADDR_ANY;
-  server_addr.sin_port = htons(PORT); // FTP default port
+  server_addr.sin_port = htons(cfg->port); // FTP default port
 
   // 绑定套接字到地址
   if (bind(server_fd, (sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-    std::cerr << "Bind failed" << std::endl;
+    std::cerr << "Bind failed: " << strerror(errno) << std::endl;
     close(server_fd);
     exit(BIND_SOCKET_ERROR);
   }
   // 开始监听连接
-  if (listen(server_fd, MAX_CONNECTIONS) < 0) {
+  if (listen(server_fd, cfg->max_connections) < 0) {
     std::cerr << "Listen failed" << std::endl;
     close(server_fd);
     exit(BIND_SOCKET_ERROR);
   }
-  std::cout << "FTP server started on port 21" << std::endl;
-  while (true) {
-    sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    int client_fd =
-        accept(server_fd, (struct sockaddr *)&client_addr, &addr_len);
-    if (client_fd < 0) {
-      std::cerr << "Accept failed" << std::endl;
-      continue;
-    }
-    auto tmp_thread = std::thread(&FtpServer::handle_client,
-                                  std::ref(client_addr), client_fd);
-    tmp_thread.detach();
+  return server_fd;
+}
+
+void FtpServer::drain(int timeout) {
+  std::cout << "Draining " << active_sessions << " sessions" << std::endl;
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+  while (active_sessions > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
   }
+  // 超时后强制关闭剩余会话
+  stop();
 }
 
 void FtpServer::stop() {
   // 停止服务器
   std::cout << "Stopping FTP server..." << std::endl;
+  // 只关闭连接，等待中的 IO 随之出错，会话协程照常退出并移除自己的信息
+  // 数据连接可能刚被会话关闭而编号被复用，此时所有会话都在关闭，不受影响
   {
     std::lock_guard<std::mutex> lock(clients_mutex);
-    for (auto &client : clients) {
-      close(client.second.client_fd);
-      client.second.client_fd = -1;
-      client.second.data_fd = -1;
+    for (auto &[ip, session] : clients) {
+      shutdown(session.client_fd, SHUT_RDWR);
+      if (session.data_fd >= 0) {
+        shutdown(session.data_fd, SHUT_RDWR);
+      }
     }
-    clients.clear();
   }
-  {
-    std::lock_guard<std::mutex> lock(users_mutex);
-    users.clear();
+  auto deadline = std::chrono::steady_clock::now() + CLOSE_TIMEOUT;
+  while (active_sessions > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
   }
-  {
-    std::lock_guard<std::mutex> lock(login_status_mutex);
-    login_status.clear();
+  if (active_sessions > 0) {
+    std::cerr << active_sessions << " sessions did not exit" << std::endl;
   }
+  // 事件循环线程结束后才能释放静态对象
+  Executor::stop();
   std::cout << "FTP server stopped." << std::endl;
 }
 
-int FtpServer::handle_client(sockaddr_in &addr, int client_fd) {
-  char buffer[BUFFER_SIZE];
+Task<int> FtpServer::handle_client(sockaddr_in addr, int client_fd) {
+  // 会话期间使用建立连接时的缓冲区大小
+  auto cfg = Config::get();
+  auto buffer = BufferPool::acquire(cfg->buffer_size);
+  // 命令级的临时字符串从会话 arena 分配，每条命令处理完后整体回收
+  std::array<std::byte, ARENA_SIZE> arena_buffer;
+  std::pmr::monotonic_buffer_resource arena(arena_buffer.data(),
+                                            arena_buffer.size());
+  // 以 IP:端口 作为会话标识，同一 IP 的多个客户端互不影响
   std::string ip = inet_ntoa(addr.sin_addr);
+  ip.append(":").append(std::to_string(ntohs(addr.sin_port)));
+  // 超出最大连接数时拒绝服务
+  if (active_sessions.fetch_add(1) >= cfg->max_connections) {
+    active_sessions.fetch_sub(1);
+    std::cerr << "Too many connections, reject " << ip << std::endl;
+    std::string_view busy_msg = "421 Too many connections\r\n";
+    send(client_fd, busy_msg.data(), busy_msg.size(), 0);
+    close(client_fd);
+    co_return SERVER_INNER_ERROR;
+  }
   std::cout << "Client connected: " << ip << std::endl;
+  // 应答都是完整的一行，立即发出；否则传输结束时的 226 要等对端对 150
+  // 的延迟确认，连续传输多个文件时每个文件多出约 40ms
+  int nodelay = 1;
+  setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
   {
     std::lock_guard<std::mutex> lock(clients_mutex);
     clients[ip].address = addr;
     clients[ip].client_fd = client_fd;
     clients[ip].curr_path = "/"; // 设置根目录
+    clients[ip].cwd = Path::root();
+    clients[ip].arena = &arena;
+    clients[ip].session_id = ++last_session;
   }
-  std::string welcome_msg = "220 Welcome to the FTP server\r\n";
-  send(client_fd, welcome_msg.c_str(), welcome_msg.size(), 0);
-  while (true) {
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_received = recv(client_fd, buffer, BUFFER_SIZE, 0);
-    if (bytes_received <= 0) {
+  co_await reply(ip, "220 Welcome to the FTP server\r\n");
+  size_t buffered = 0; // 缓冲区中已接收但未处理的字节数
+  size_t served = 0;   // 已处理的命令数
+  bool running = true;
+  while (running) {
+    // 定期让出事件循环，连续发送大量命令的客户端不会独占线程
+    if (++served % YIELD_INTERVAL == 0) {
+      co_await Executor::yield();
+    }
+    arena.release();
+    std::pmr::string command(&arena);
+    ssize_t line_size = co_await recv_line(client_fd, client(ip).ssl, buffer,
+                                           buffered, command);
+    if (line_size < 0) {
       std::cerr << "Client disconnected: " << ip << std::endl;
-      close(client_fd);
       break;
     }
-    std::string command(buffer);
+    if (line_size == 0) {
+      co_await reply(ip, "500 Command line too long\r\n");
+      continue;
+    }
     std::cout << "Received command from " << ip << ": " << command << std::endl;
+    client(ip).trace.begin(client(ip).session_id, command);
     Command cmd = Parser::parse(command);
     switch (cmd) {
     case Command::USER:
-      handle_user(ip, command);
+      co_await handle_user(ip, command);
       break;
     case Command::PASS:
-      handle_pass(ip, command);
+      co_await handle_pass(ip, command);
       break;
     case Command::LIST:
-      handle_list(ip, command);
+      co_await handle_list(ip, command);
       break;
     case Command::GET:
-      handle_get(ip, command);
+      co_await handle_get(ip, command);
       break;
     case Command::RETR:
-      handle_get(ip, command);
+      co_await handle_get(ip, command);
+      break;
+    case Command::STOR:
+      co_await handle_put(ip, command);
       break;
     case Command::QUIT:
-      handle_quit(ip);
+      co_await handle_quit(ip);
+      running = false;
       break;
     case Command::PWD:
-      handle_pwd(ip, command);
+      co_await handle_pwd(ip, command);
+      break;
+    case Command::CWD:
+      co_await handle_lcd(ip, command);
+      break;
+    case Command::CDUP:
+      co_await handle_lcd(ip, "..");
       break;
     case Command::LCD:
-      handle_lcd(ip, command);
+      co_await handle_lcd(ip, command);
       break;
     case Command::SYST:
-      handle_syst(ip);
+      co_await handle_syst(ip);
       break;
     case Command::EPSV:
-      handle_epsv(ip);
+      co_await handle_epsv(ip);
       break;
     case Command::PASV:
-      handle_pasv(ip);
+      co_await handle_pasv(ip);
       break;
     case Command::PORT: {
-      handle_port(ip, command);
+      co_await handle_port(ip, command);
       break;
     }
     case Command::TYPE: {
-      handle_type(ip);
+      co_await handle_type(ip);
+      break;
+    }
+    case Command::AUTH: {
+      // 握手前客户端多发的明文命令一律丢弃，防止被注入到加密会话中
+      buffered = 0;
+      co_await handle_auth(ip, command);
+      break;
+    }
+    case Command::PBSZ: {
+      co_await handle_pbsz(ip, command);
+      break;
+    }
+    case Command::PROT: {
+      co_await handle_prot(ip, command);
+      break;
+    }
+    case Command::SITE: {
+      co_await handle_site(ip, command);
+      break;
+    }
+    case Command::MODE: {
+      co_await handle_mode(ip, command);
+      break;
+    }
+    case Command::REST: {
+      co_await handle_rest(ip, command);
       break;
     }
     case Command::ERROR: {
       std::cerr << "Invalid command" << std::endl;
-      std::string error_msg = "500 Unknown command\r\n";
-      send(client_fd, error_msg.c_str(), error_msg.size(), 0);
+      co_await reply(ip, "500 Unknown command\r\n");
       break;
     }
     }
+    client(ip).trace.end();
+    // REST 只对紧随其后的传输命令有效
+    if (cmd != Command::REST) {
+      client(ip).restart = 0;
+    }
+  }
+  // 会话结束：先移除会话信息再关闭控制连接，stop 不会关闭被复用的编号
+  release_data(ip);
+  Tls::close(client(ip).ssl);
+  {
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    if (it != users.end()) {
+      users.erase(it);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(login_status_mutex);
+    auto it = login_status.find(ip);
+    if (it != login_status.end()) {
+      login_status.erase(it);
+    }
   }
   {
     std::lock_guard<std::mutex> lock(clients_mutex);
-    clients.erase(ip);
+    clients.erase(clients.find(ip));
   }
-  return COMMON;
+  close(client_fd);
+  active_sessions.fetch_sub(1);
+  co_return COMMON;
 }
 
-int FtpServer::handle_user(std::string_view ip, std::string_view username) {
-  {
-    std::lock_guard<std::mutex> lock(users_mutex);
-    users[std::string(ip)] = username;
-    std::cout << "User " << username << " logged in from " << ip << std::endl;
-    std::string response = "331 User name okay, need password\r\n";
-    send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-         0);
-    return COMMON;
-  }
-  return SERVER_INNER_ERROR;
-}
-
-int FtpServer::handle_pass(std::string_view ip, std::string_view password) {
-  auto username = users[std::string(ip)];
-  if (USER_INFO.size() == 0) {
-    std::cerr << "No user information available" << std::endl;
-    std::string mess = "530 Login incorrect\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
-  }
-  for (const auto &user : USER_INFO) {
-    if (user.first == username && user.second == password) {
-      {
-        std::lock_guard<std::mutex> lock(login_status_mutex);
-        login_status[std::string(ip)] = true;
-        std::string mess = "230 User logged in, proceed\r\n";
-        send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-      }
-      return COMMON;
+// 读取一行命令（含行尾 \r\n），连接断开返回 -1，行超过缓冲区大小返回 0
+Task<ssize_t> FtpServer::recv_line(int fd, SSL *ssl, Buffer &buffer,
+                                   size_t &buffered, std::pmr::string &line) {
+  while (true) {
+    char *begin = buffer.data();
+    char *end = begin + buffered;
+    char *newline = std::find(begin, end, '\n');
+    if (newline != end) {
+      line.assign(begin, newline + 1);
+      buffered = end - (newline + 1);
+      memmove(begin, newline + 1, buffered);
+      co_return line.size();
+    }
+    if (buffered == buffer.size()) {
+      // 丢弃过长的命令
+      buffered = 0;
+      co_return 0;
     }
+    ssize_t bytes_received =
+        ssl != nullptr
+            ? co_await Tls::recv(ssl, end, buffer.size() - buffered)
+            : co_await Executor::async_recv(fd, end, buffer.size() - buffered);
+    if (bytes_received <= 0) {
+      co_return -1;
+    }
+    buffered += bytes_received;
   }
-  std::string mess = "530 Login incorrect\r\n";
-  send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-  return SERVER_INNER_ERROR;
 }
 
-int FtpServer::handle_list(std::string_view ip, std::string_view path) {
-  // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
-    std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+// 获取已建立的数据连接，被动模式下等待客户端连接
+// PROT P 时在数据连接上完成 TLS 握手，ssl 为空表示明文
+Task<int> FtpServer::accept_data(std::string_view ip, SSL *&ssl) {
+  auto &trace = client(ip).trace;
+  if (client(ip).data_open) {
+    // 块模式下沿用上一次传输的连接
+    trace.mark(Recorder::ACCEPTED);
+    ssl = client(ip).data_ssl;
+    co_return client(ip).data_fd;
   }
-  try {
-    std::string directory;
-    if (path == "") {
-      if (clients[std::string(ip)].curr_path != "/") {
-        directory = ROOT_PATH + '/' + clients[std::string(ip)].curr_path;
-      } else {
-        directory = ROOT_PATH;
-      }
-    } else {
-      if (clients[std::string(ip)].curr_path != "/") {
-        directory = ROOT_PATH + '/' + clients[std::string(ip)].curr_path + '/' +
-                    std::string(path);
-      } else {
-        directory = ROOT_PATH + '/' + std::string(path);
-      }
+  ssl = nullptr;
+  int data_fd = client(ip).data_fd;
+  int conn_fd = data_fd;
+  if (!client(ip).is_positive) {
+    std::cout << "Waiting for data connection..." << std::endl;
+    trace.mark(Recorder::PASV_READY, client(ip).pasv_ready);
+    sockaddr_in client_data_addr;
+    conn_fd = co_await Executor::async_accept(data_fd, client_data_addr);
+    int error = errno;
+    // 被动模式的监听套接字只使用一次，传输期间记录已建立的连接
+    close(data_fd);
+    client(ip).data_fd = conn_fd;
+    if (conn_fd < 0) {
+      std::cerr << "Accept data connection failed" << std::endl;
+      trace.fail(error);
+      co_return -1;
     }
-    std::cout << "paragram path: " << path << std::endl;
-    std::cout << "Listing directory: " << directory << std::endl;
+  }
+  trace.mark(Recorder::ACCEPTED);
+  if (!client(ip).protect_data) {
+    co_return conn_fd;
+  }
+  // 客户端通常复用控制连接的 TLS 会话，只需简短握手
+  ssl = co_await Tls::accept(conn_fd);
+  if (ssl == nullptr) {
+    close(conn_fd);
+    client(ip).data_fd = -1;
+    co_return -1;
+  }
+  co_return conn_fd;
+}
 
-    std::stringstream file_list;
-    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
-      const auto &path = entry.path();
-      const auto &status = entry.status();
+Task<ssize_t> FtpServer::send_data(int data_fd, SSL *ssl, const char *data,
+                                   size_t size) {
+  if (ssl != nullptr) {
+    co_return co_await Tls::send(ssl, data, size);
+  }
+  co_return co_await Executor::async_send(data_fd, data, size);
+}
 
-      // 获取文件信息
-      std::string permissions;
-      if (std::filesystem::is_directory(status)) {
-        permissions = "drwxr-xr-x";
-      } else {
-        permissions = "-rw-r--r--";
+// 将文件从 offset 起的内容写入数据连接，返回发送的字节数，失败返回 -1
+// 明文与内核 TLS 连接使用 sendfile 零拷贝，其余情况经缓冲区发送
+// 套接字选项与文件预读在传输期间按测得的 RTT 与发送速率调整
+// 文件仍在填充时每次只发送已就绪的部分
+// block 为 true 时按块模式分块，定期插入重启标记，最后发送 EOF 块
+// 块模式经缓冲区发送，块头与数据一次写出：单独写出的块头在保持的连接
+// 上形成小报文段，空闲后重新慢启动时会等待对端的延迟确认
+Task<ssize_t> FtpServer::send_file(int data_fd, SSL *ssl, ReadFile &file,
+                                   size_t chunk_size, size_t offset, bool block,
+                                   Recorder::Trace &trace) {
+  bool zero_copy = file.fd() >= 0 && !block &&
+                   (ssl == nullptr || Tls::ktls_send(ssl));
+  // 每次发送的字节数随测得的带宽时延积调整
+  Tuner tuner(data_fd, file.fd(), file.size(),
+              std::max<size_t>(chunk_size, 16 * 1024));
+  Buffer buffer;
+  size_t total_sent = offset;
+  size_t next_marker = offset + Block::MARKER_INTERVAL;
+  char frame[Block::HEADER_SIZE + 24];
+  while (total_sent < file.size()) {
+    ssize_t end = co_await file.readable(total_sent);
+    if (end <= static_cast<ssize_t>(total_sent)) {
+      trace.fail(errno);
+      std::cerr << "Failed to read file data" << std::endl;
+      co_return -1;
+    }
+    size_t count = std::min(end - total_sent, tuner.chunk_size());
+    if (block && total_sent >= next_marker) {
+      // 重启标记为已发送的字节数，客户端可以凭它 REST 后续传
+      auto marker = std::to_chars(frame + Block::HEADER_SIZE,
+                                  frame + sizeof(frame), total_sent);
+      size_t length = marker.ptr - frame - Block::HEADER_SIZE;
+      Block::header(frame, Block::RESTART, length);
+      if (co_await send_data(data_fd, ssl, frame,
+                             Block::HEADER_SIZE + length) < 0) {
+        trace.fail(errno);
+        std::cerr << "Failed to send file data" << std::endl;
+        co_return -1;
       }
-
-      // 获取文件大小
-      uintmax_t file_size = 0;
-      if (std::filesystem::is_regular_file(status)) {
-        file_size = std::filesystem::file_size(path);
+      next_marker = total_sent + Block::MARKER_INTERVAL;
+    }
+    ssize_t bytes_sent = 0;
+    if (zero_copy && ssl == nullptr) {
+      bytes_sent = co_await Executor::async_sendfile(data_fd, file.fd(),
+                                                     total_sent, count);
+    } else if (zero_copy) {
+      bytes_sent = co_await Tls::sendfile(ssl, file.fd(), total_sent, count);
+    } else {
+      size_t header = block ? Block::HEADER_SIZE : 0;
+      if (block) {
+        count = std::min(count, Block::MAX_SIZE);
+      }
+      // 调优器加大块大小后换用更大的缓冲区，每次至少填满一个 TLS 记录
+      if (buffer.size() < header + count) {
+        buffer =
+            BufferPool::acquire(std::max<size_t>(header + count, 16 * 1024));
+      }
+      ssize_t bytes_read =
+          file.read(buffer.data() + header, count, total_sent);
+      if (bytes_read > 0 && block) {
+        Block::header(buffer.data(), 0, bytes_read);
       }
+      bytes_sent = bytes_read <= 0
+                       ? -1
+                       : co_await send_data(data_fd, ssl, buffer.data(),
+                                            header + bytes_read);
+      if (bytes_sent > 0) {
+        bytes_sent -= header;
+      }
+    }
+    if (bytes_sent <= 0) {
+      trace.fail(errno);
+      std::cerr << "Failed to send file data" << std::endl;
+      co_return -1;
+    }
+    if (total_sent == offset) {
+      trace.mark(Recorder::FIRST_BYTE);
+    }
+    trace.add_bytes(bytes_sent);
+    total_sent += bytes_sent;
+    tuner.advance(total_sent);
+  }
+  if (block) {
+    Block::header(frame, Block::END, 0);
+    if (co_await send_data(data_fd, ssl, frame, Block::HEADER_SIZE) < 0) {
+      trace.fail(errno);
+      co_return -1;
+    }
+  }
+  trace.mark(Recorder::LAST_BYTE);
+  co_return total_sent - offset;
+}
 
-      // 获取修改时间
-      auto ftime = std::filesystem::last_write_time(path);
-      auto sctp =
-          std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-              ftime - std::filesystem::file_time_type::clock::now() +
-              std::chrono::system_clock::now());
-      std::time_t cftime = std::chrono::system_clock::to_time_t(sctp);
+Task<ssize_t> FtpServer::recv_data(int data_fd, SSL *ssl, char *data,
+                                   size_t size) {
+  if (ssl != nullptr) {
+    co_return co_await Tls::recv(ssl, data, size);
+  }
+  co_return co_await Executor::async_recv(data_fd, data, size);
+}
 
-      // 格式化文件信息 (类似 ls -l 格式)
-      char time_buffer[100];
-      std::strftime(time_buffer, sizeof(time_buffer), "%b %d %H:%M",
-                    std::localtime(&cftime));
+void FtpServer::close_data(int data_fd, SSL *ssl) {
+  Tls::close(ssl);
+  close(data_fd);
+}
+
+// 块模式下分块发送，最后一块带 EOF 描述符，空内容只发送一个 EOF 块
+// 块头与数据拼接后一次写出
+Task<ssize_t> FtpServer::send_content(int data_fd, SSL *ssl, const char *data,
+                                      size_t size, bool block,
+                                      Recorder::Trace &trace) {
+  trace.mark(Recorder::FIRST_BYTE);
+  if (!block) {
+    ssize_t bytes_sent = co_await send_data(data_fd, ssl, data, size);
+    if (bytes_sent < 0) {
+      trace.fail(errno);
+      co_return -1;
+    }
+    trace.add_bytes(bytes_sent);
+    trace.mark(Recorder::LAST_BYTE);
+    co_return bytes_sent;
+  }
+  std::string frames;
+  frames.reserve(size + (size / Block::MAX_SIZE + 1) * Block::HEADER_SIZE);
+  size_t sent = 0;
+  do {
+    size_t n = std::min(size - sent, Block::MAX_SIZE);
+    char header[Block::HEADER_SIZE];
+    Block::header(header, sent + n == size ? Block::END : 0, n);
+    frames.append(header, sizeof(header)).append(data + sent, n);
+    sent += n;
+  } while (sent < size);
+  if (co_await send_data(data_fd, ssl, frames.data(), frames.size()) < 0) {
+    trace.fail(errno);
+    co_return -1;
+  }
+  trace.add_bytes(size);
+  trace.mark(Recorder::LAST_BYTE);
+  co_return size;
+}
 
-      file_list << permissions << " 1 user group " << std::setw(10) << file_size
-                << " " << time_buffer << " " << path.filename().string()
-                << "\r\n";
+// 返回收到的内容字节数，上传结束返回 0，出错返回 -1
+// reader 不为空时按块模式解析，收到 EOF 块即结束，此前断开视为中止
+Task<ssize_t> FtpServer::recv_content(int data_fd, SSL *ssl,
+                                      BlockReader *reader, char *data,
+                                      size_t size) {
+  if (reader == nullptr) {
+    co_return co_await recv_data(data_fd, ssl, data, size);
+  }
+  while (!reader->done()) {
+    ssize_t bytes_received = co_await recv_data(data_fd, ssl, data, size);
+    if (bytes_received <= 0) {
+      co_return -1;
     }
+    ssize_t n = reader->decode(data, bytes_received);
+    if (n != 0) {
+      co_return n;
+    }
+  }
+  co_return 0;
+}
 
-    // 发送文件列表
-    std::string response = "150 Here comes the directory listing\r\n";
-    send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-         0);
+// 块模式下传输成功时保持数据连接，之后的传输不需要再次 PASV
+void FtpServer::finish_data(std::string_view ip, int data_fd, SSL *ssl,
+                            bool ok) {
+  auto &session = client(ip);
+  if (ok && session.block_mode) {
+    session.data_fd = data_fd;
+    session.data_ssl = ssl;
+    session.data_open = true;
+    return;
+  }
+  if (!ok) {
+    session.trace.fail(errno);
+  }
+  close_data(data_fd, ssl);
+  session.data_fd = -1;
+  session.data_ssl = nullptr;
+  session.data_open = false;
+}
 
-    std::string list_data = file_list.str();
-    send(clients[std::string(ip)].client_fd, list_data.c_str(),
-         list_data.size(), 0);
+void FtpServer::release_data(std::string_view ip) {
+  auto &session = client(ip);
+  if (session.data_fd != -1) {
+    close_data(session.data_fd, session.data_ssl);
+  }
+  session.data_fd = -1;
+  session.data_ssl = nullptr;
+  session.data_open = false;
+}
 
-    response = "226 Directory send OK\r\n";
-    send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-         0);
+// 数据连接已关闭时为 226，块模式下保持打开时为 250
+Task<int> FtpServer::complete(std::string_view ip, std::string_view message) {
+  std::pmr::string response(arena(ip));
+  response.append(client(ip).data_open ? "250 " : "226 ")
+      .append(message)
+      .append("\r\n");
+  co_return co_await reply(ip, response);
+}
 
-  } catch (const std::filesystem::filesystem_error &ex) {
-    std::cerr << "Filesystem error: " << ex.what() << std::endl;
-    std::string error_msg = "550 Failed to open directory\r\n";
-    send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-         error_msg.size(), 0);
-    return SERVER_INNER_ERROR;
+// 会话信息只由会话自己的协程移除，找不到说明调用方已不在会话中
+Client &FtpServer::client(std::string_view ip) {
+  std::lock_guard<std::mutex> lock(clients_mutex);
+  auto it = clients.find(ip);
+  if (it == clients.end()) {
+    throw std::out_of_range("session " + std::string(ip) + " not found");
   }
-  return COMMON;
+  return it->second;
 }
 
-int FtpServer::handle_quit(std::string_view ip) {
-  // 退出登录
-  std::cout << "User " << users[std::string(ip)] << " logged out from " << ip
-            << std::endl;
-  std::string mess = "221 Goodbye\r\n";
-  send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-  close(clients[std::string(ip)].client_fd);
-  {
-    std::lock_guard<std::mutex> lock(users_mutex);
-    users.erase(std::string(ip));
+bool FtpServer::logged_in(std::string_view ip) {
+  std::lock_guard<std::mutex> lock(login_status_mutex);
+  auto it = login_status.find(ip);
+  return it != login_status.end() && it->second;
+}
+
+// 控制连接为非阻塞套接字，对端不读取应答时只挂起本会话
+Task<int> FtpServer::reply(std::string_view ip, std::string_view message) {
+  auto &session = client(ip);
+  ssize_t sent =
+      session.ssl != nullptr
+          ? co_await Tls::send(session.ssl, message.data(), message.size())
+          : co_await Executor::async_send(session.client_fd, message.data(),
+                                          message.size());
+  session.trace.reply(message);
+  co_return sent < 0 ? SERVER_INNER_ERROR : COMMON;
+}
+
+std::pmr::memory_resource *FtpServer::arena(std::string_view ip) {
+  return client(ip).arena;
+}
+
+Task<int> FtpServer::handle_user(std::string_view ip,
+                                 std::string_view username) {
+  // 策略要求加密时不接受明文传输的帐号
+  if (Config::get()->tls_required && client(ip).ssl == nullptr) {
+    co_await reply(ip, "530 Use AUTH TLS first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
+  // 新的 USER 开始一次新的登录，之前的认证作废，需再次 PASS
   {
     std::lock_guard<std::mutex> lock(login_status_mutex);
-    login_status.erase(std::string(ip));
+    auto it = login_status.find(ip);
+    if (it != login_status.end()) {
+      it->second = false;
+    }
   }
   {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    clients[std::string(ip)].client_fd = -1;
-    clients[std::string(ip)].data_fd = -1;
-    clients[std::string(ip)].curr_path = "";
-    clients.erase(std::string(ip));
+    // 同一会话再次 USER 时复用已有的键与字符串，不再分配
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    if (it != users.end()) {
+      it->second.assign(username);
+    } else {
+      users.emplace(ip, username);
+    }
+    std::cout << "User " << username << " logged in from " << ip << std::endl;
   }
-  return COMMON;
+  co_await reply(ip, "331 User name okay, need password\r\n");
+  co_return COMMON;
 }
 
-int FtpServer::handle_get(std::string_view ip, std::string_view path) {
-  // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
-    std::string mess = "530 Not logged in\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+Task<int> FtpServer::handle_pass(std::string_view ip,
+                                 std::string_view password) {
+  std::string username;
+  {
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    if (it != users.end()) {
+      username = it->second;
+    }
   }
-  // 检查数据连接是否可用
-  if (clients[std::string(ip)].data_fd == -1) {
-    std::string mess = "425 Use PASV first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+  // 慢哈希在认证线程池中校验，不阻塞事件循环
+  int result = co_await User::handle_pass(username, password);
+  if (result == AUTH_BUSY) {
+    std::cerr << "Authentication queue is full" << std::endl;
+    co_await reply(ip, "421 Too many login attempts, try again later\r\n");
+    co_return AUTH_BUSY;
   }
-
-  try {
-    std::string file_path;
-    if (clients[std::string(ip)].curr_path == "/") {
-      file_path = ROOT_PATH + "/" + path.data();
+  if (result != COMMON) {
+    co_await reply(ip, "530 Login incorrect\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  {
+    std::lock_guard<std::mutex> lock(login_status_mutex);
+    auto it = login_status.find(ip);
+    if (it != login_status.end()) {
+      it->second = true;
     } else {
-      file_path = ROOT_PATH + "/" + clients[std::string(ip)].curr_path + "/" +
-                  path.data();
+      login_status.emplace(ip, true);
     }
+  }
+  co_await reply(ip, "230 User logged in, proceed\r\n");
+  co_return COMMON;
+}
 
-    std::cout << "Requesting file: " << path << std::endl;
-    std::cout << "Full path: " << file_path << std::endl;
-
-    // 检查文件是否存在
-    if (!std::filesystem::exists(file_path)) {
-      std::string error_msg = "550 File not found\r\n";
-      send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-           error_msg.size(), 0);
-      return SERVER_INNER_ERROR;
-    }
+// 按 ls -l 格式输出一项
+static void list_entry(std::stringstream &out, std::string_view name, bool dir,
+                       uintmax_t file_size, time_t mtime) {
+  // 获取文件信息
+  std::string_view permissions = dir ? "drwxr-xr-x" : "-rw-r--r--";
 
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-      std::string error_msg = "550 Failed to open file\r\n";
-      send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-           error_msg.size(), 0);
-      return SERVER_INNER_ERROR;
-    }
+  // 格式化文件信息 (类似 ls -l 格式)
+  char time_buffer[100];
+  std::strftime(time_buffer, sizeof(time_buffer), "%b %d %H:%M",
+                std::localtime(&mtime));
 
-    // 获取文件大小
-    file.seekg(0, std::ios::end);
-    size_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+  out << permissions << " 1 user group " << std::setw(10) << file_size << " "
+      << time_buffer << " " << name << "\r\n";
+}
 
-    // 发送 150 响应到控制连接
-    std::string response = std::format(
-        "150 Opening BINARY mode data connection for {} bytes\r\n", file_size);
-    send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-         0);
-
-    // 检查客户端是否处于被动模式
-    if (!clients[std::string(ip)].is_positive) {
-      // 等待客户端连接数据端口
-      int listen_fd = clients[std::string(ip)].data_fd;
-      sockaddr_in client_data_addr;
-      socklen_t addr_len = sizeof(client_data_addr);
-
-      std::cout << "Waiting for data connection..." << std::endl;
-      int data_fd =
-          accept(listen_fd, (struct sockaddr *)&client_data_addr, &addr_len);
-      if (data_fd < 0) {
-        std::cerr << "Accept data connection failed" << std::endl;
-        std::string error_msg = "425 Cannot open data connection\r\n";
-        send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-             error_msg.size(), 0);
-        file.close();
-        close(listen_fd);
-        clients[std::string(ip)].data_fd = -1;
-        return SERVER_INNER_ERROR;
+Task<int> FtpServer::handle_list(std::string_view ip, std::string_view path) {
+  // 检查登陆状态
+  if (!logged_in(ip)) {
+    std::cerr << "User not logged in" << std::endl;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  auto cfg = Config::get();
+  if (cfg->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 以 - 开头的参数为 ls 选项，只识别 -R（递归，由索引回答）
+  bool recursive = false;
+  while (path.starts_with('-')) {
+    size_t end = path.find(' ');
+    recursive |= path.substr(0, end).find('R') != std::string_view::npos;
+    path = end == std::string_view::npos ? "" : path.substr(end + 1);
+  }
+  std::stringstream file_list;
+  if (recursive) {
+    if (!Index::ready()) {
+      co_await reply(ip, "450 Index not available\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    std::pmr::string target(arena(ip));
+    Path::normalize(client(ip).curr_path, path, target);
+    bool first = true;
+    bool found = Index::walk(target, [&](std::string_view dir,
+                                         const Index::Node &node) {
+      file_list << (first ? "" : "\r\n") << (dir.empty() ? "." : "./")
+                << dir << ":\r\n";
+      first = false;
+      for (auto &[name, child] : node.children) {
+        list_entry(file_list, name, child.dir, child.size, child.mtime);
       }
+    });
+    if (!found) {
+      co_await reply(ip, "550 Failed to open directory\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+  } else {
+    // 目录相对会话当前目录打开，不会越出根目录
+    auto storage = Storage::get();
+    int dir_fd = storage->open_dir(client(ip), path);
+    DIR *dir = dir_fd < 0 ? nullptr : fdopendir(dir_fd);
+    if (dir == nullptr) {
+      std::cerr << "Failed to open directory " << path << ": "
+                << strerror(errno) << std::endl;
+      if (dir_fd >= 0) {
+        close(dir_fd);
+      }
+      co_await reply(ip, "550 Failed to open directory\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    std::cout << "Listing directory: " << client(ip).curr_path << " " << path
+              << std::endl;
+    while (dirent *entry = readdir(dir)) {
+      std::string_view name = entry->d_name;
+      if (name == "." || name == "..") {
+        continue;
+      }
+      struct stat status;
+      if (storage->stat_at(dirfd(dir), entry->d_name, status) < 0) {
+        continue;
+      }
+      list_entry(file_list, name, S_ISDIR(status.st_mode),
+                 S_ISREG(status.st_mode) ? status.st_size : 0,
+                 status.st_mtime);
+    }
+    closedir(dir);
+  }
+  std::string list_data = file_list.str();
 
-      std::cout << "Data connection established" << std::endl;
-
-      // 通过数据连接发送文件内容
-      char buffer[BUFFER_SIZE];
-      size_t total_sent = 0;
-
-      while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
-        size_t bytes_read = file.gcount();
-        ssize_t bytes_sent = send(data_fd, buffer, bytes_read, 0);
+  // 通过数据连接发送文件列表
+  co_await reply(ip, "150 Here comes the directory listing\r\n");
+  SSL *data_ssl = nullptr;
+  int data_fd = co_await accept_data(ip, data_ssl);
+  if (data_fd < 0) {
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  ssize_t bytes_sent =
+      co_await send_content(data_fd, data_ssl, list_data.data(),
+                            list_data.size(), client(ip).block_mode,
+                            client(ip).trace);
+  finish_data(ip, data_fd, data_ssl, bytes_sent >= 0);
+  if (bytes_sent < 0) {
+    co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await complete(ip, "Directory send OK");
+  co_return COMMON;
+}
 
-        if (bytes_sent < 0) {
-          std::cerr << "Failed to send file data" << std::endl;
-          break;
-        }
-        total_sent += bytes_sent;
-      }
+Task<int> FtpServer::handle_quit(std::string_view ip) {
+  // 退出登录
+  {
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    std::cout << "User "
+              << (it != users.end() ? std::string_view(it->second) : "")
+              << " logged out from " << ip << std::endl;
+  }
+  // 连接在会话结束时由 handle_client 关闭
+  co_await reply(ip, "221 Goodbye\r\n");
+  co_return COMMON;
+}
 
-      file.close();
-      close(data_fd);
-      clients[std::string(ip)].data_fd = -1;
+Task<int> FtpServer::handle_get(std::string_view ip, std::string_view path) {
+  // 检查登陆状态
+  if (!logged_in(ip)) {
+    co_await reply(ip, "530 Not logged in\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
 
-      // 发送传输完成消息到控制连接
-      response = "226 Transfer complete\r\n";
-      send(clients[std::string(ip)].client_fd, response.c_str(),
-           response.size(), 0);
+  auto cfg = Config::get();
+  if (cfg->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  bool failed = false;
+  try {
+    std::cout << "Requesting file: " << path << std::endl;
 
-      std::cout << "File " << path << " sent to " << ip << " (" << total_sent
-                << " bytes)" << std::endl;
-    } else {
-      // 如果是主动模式，直接发送到数据连接
-      int data_fd = clients[std::string(ip)].data_fd;
-      char buffer[BUFFER_SIZE];
-      size_t total_sent = 0;
-
-      while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
-        size_t bytes_read = file.gcount();
-        ssize_t bytes_sent = send(data_fd, buffer, bytes_read, 0);
-
-        if (bytes_sent < 0) {
-          std::cerr << "Failed to send file data" << std::endl;
-          break;
-        }
-        total_sent += bytes_sent;
-      }
+    // 经由存储后端打开文件，路径相对会话当前目录；
+    // 打开、查询缓存都可能阻塞，在磁盘线程中进行
+    auto file = co_await Executor::blocking([&session = client(ip), path] {
+      return Storage::get()->open_read(session, path);
+    });
+    if (file == nullptr && errno == ENOENT && path.size() > 4 &&
+        path.ends_with(".tar")) {
+      // 没有同名文件时把 <目录>.tar 作为目录的归档流发送
+      file = co_await Archive::open(client(ip),
+                                    path.substr(0, path.size() - 4));
+    }
+    if (file == nullptr) {
+      client(ip).trace.fail(errno);
+      co_await reply(ip, errno == ENOENT ? "550 File not found\r\n"
+                                         : "550 Failed to open file\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    size_t file_size = file->size();
+    // REST 设置的起点，用于续传
+    size_t offset = std::exchange(client(ip).restart, 0);
+    if (offset > file_size) {
+      co_await reply(ip, "554 Invalid restart position\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
 
-      file.close();
-      close(data_fd);
-      clients[std::string(ip)].data_fd = -1;
+    // 发送 150 响应到控制连接
+    std::pmr::string response(arena(ip));
+    std::format_to(std::back_inserter(response),
+                   "150 Opening BINARY mode data connection for {} bytes\r\n",
+                   file_size - offset);
+    co_await reply(ip, response);
 
-      // 发送传输完成消息到控制连接
-      response = "226 Transfer complete\r\n";
-      send(clients[std::string(ip)].client_fd, response.c_str(),
-           response.size(), 0);
+    SSL *data_ssl = nullptr;
+    int data_fd = co_await accept_data(ip, data_ssl);
+    if (data_fd < 0) {
+      co_await reply(ip, "425 Cannot open data connection\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    std::cout << "Data connection established" << std::endl;
 
-      std::cout << "File " << path << " sent to " << ip << " (" << total_sent
-                << " bytes)" << std::endl;
+    // 通过数据连接发送文件内容
+    ssize_t total_sent =
+        co_await send_file(data_fd, data_ssl, *file, cfg->buffer_size, offset,
+                           client(ip).block_mode, client(ip).trace);
+    finish_data(ip, data_fd, data_ssl, total_sent >= 0);
+    if (total_sent < 0) {
+      co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+      co_return SERVER_INNER_ERROR;
     }
 
+    // 发送传输完成消息到控制连接
+    co_await complete(ip, "Transfer complete");
+
+    std::cout << "File " << path << " sent to " << ip << " (" << total_sent
+              << " bytes)" << std::endl;
   } catch (const std::exception &ex) {
     std::cerr << "Error in handle_get: " << ex.what() << std::endl;
-    std::string error_msg = "550 Transfer failed\r\n";
-    send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-         error_msg.size(), 0);
-    return SERVER_INNER_ERROR;
+    failed = true;
   }
-  return COMMON;
+  // 异常处理块中不能 co_await，离开后再应答
+  if (failed) {
+    co_await reply(ip, "550 Transfer failed\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_return COMMON;
+}
+
+Task<int> FtpServer::handle_put(std::string_view ip, std::string_view path) {
+  // 检查登陆状态
+  if (!logged_in(ip)) {
+    co_await reply(ip, "530 Not logged in\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  auto cfg = Config::get();
+  if (cfg->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (client(ip).restart != 0) {
+    // 上传先写入临时文件，中断后不保留已接收的部分，无法续传
+    co_await reply(ip, "554 Restart not supported for uploads\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  std::cout << "Uploading file: " << path << std::endl;
+  // 上传完成前写入临时文件，其他会话看不到不完整的内容
+  auto file = Storage::get()->open_write(client(ip), path);
+  if (file == nullptr) {
+    client(ip).trace.fail(errno);
+    std::cerr << "Failed to create file " << path << ": " << strerror(errno)
+              << std::endl;
+    co_await reply(ip, "553 Could not create file\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await reply(ip, "150 Ok to send data\r\n");
+  SSL *data_ssl = nullptr;
+  int data_fd = co_await accept_data(ip, data_ssl);
+  if (data_fd < 0) {
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  auto buffer =
+      BufferPool::acquire(std::max<size_t>(cfg->buffer_size, 64 * 1024));
+  BlockReader reader;
+  BlockReader *blocks = client(ip).block_mode ? &reader : nullptr;
+  auto &trace = client(ip).trace;
+  ssize_t total_received = 0;
+  ssize_t bytes_received = 0;
+  while ((bytes_received = co_await recv_content(data_fd, data_ssl, blocks,
+                                                 buffer.data(),
+                                                 buffer.size())) > 0) {
+    if (total_received == 0) {
+      trace.mark(Recorder::FIRST_BYTE);
+    }
+    trace.add_bytes(bytes_received);
+    // 写入（去重存储还要分块与计算摘要）在磁盘线程中进行
+    ssize_t written = co_await Executor::blocking(
+        [&file, &buffer, bytes_received] {
+          return file->write(buffer.data(), bytes_received);
+        });
+    if (written < 0) {
+      break;
+    }
+    total_received += bytes_received;
+  }
+  trace.mark(Recorder::LAST_BYTE);
+  finish_data(ip, data_fd, data_ssl, bytes_received == 0);
+  // 数据连接正常关闭（块模式下收到 EOF 块）表示上传结束
+  if (bytes_received < 0) {
+    co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (bytes_received > 0 ||
+      !co_await Executor::blocking([&file] { return file->commit(); })) {
+    std::cerr << "Failed to write file " << path << ": " << strerror(errno)
+              << std::endl;
+    co_await reply(ip, "451 Failed to write file\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await complete(ip, "Transfer complete");
+  std::cout << "File " << path << " received from " << ip << " ("
+            << total_received << " bytes)" << std::endl;
+  co_return COMMON;
 }
 
 // 列出当前目录
-int FtpServer::handle_pwd(std::string_view ip, std::string_view path) {
+Task<int> FtpServer::handle_pwd(std::string_view ip, std::string_view path) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  std::string response = "257 \"" + clients[std::string(ip)].curr_path +
-                         "\" is the current directory\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
+  std::pmr::string response(arena(ip));
+  response.append("257 \"")
+      .append(client(ip).curr_path)
+      .append("\" is the current directory\r\n");
+  co_await reply(ip, response);
+  co_return COMMON;
 }
 
-int FtpServer::handle_lcd(std::string_view ip, std::string_view path) {
+Task<int> FtpServer::handle_lcd(std::string_view ip, std::string_view path) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  // 切换目录
-  if (clients[std::string(ip)].curr_path == "/") {
-    clients[std::string(ip)].curr_path = std::string(path);
-  } else {
-    clients[std::string(ip)].curr_path += '/' + std::string(path);
+  // 切换目录，先规范化再打开，.. 最多回到根目录
+  std::pmr::string target(arena(ip));
+  Path::normalize(client(ip).curr_path, path, target);
+  // 从根目录重新查找，会话持有的始终是核对过的句柄
+  auto dir = Path::reopen_dir(target);
+  if (dir == nullptr) {
+    std::cerr << "Failed to change directory to " << target << ": "
+              << strerror(errno) << std::endl;
+    co_await reply(ip, "550 Failed to change directory\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  std::string response = "250 Directory changed to " +
-                         std::string(clients[std::string(ip)].curr_path) +
-                         "\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
+  client(ip).cwd = std::move(dir);
+  client(ip).curr_path = target;
+  std::pmr::string response(arena(ip));
+  response.append("250 Directory changed to ")
+      .append(client(ip).curr_path)
+      .append("\r\n");
+  co_await reply(ip, response);
+  co_return COMMON;
 }
 
-int FtpServer::handle_syst(std::string_view ip) {
+Task<int> FtpServer::handle_syst(std::string_view ip) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  std::string response = "215 UNIX Type: L8\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
+  co_await reply(ip, "215 UNIX Type: L8\r\n");
+  co_return COMMON;
 }
 
-int FtpServer::handle_pasv(std::string_view ip) {
+Task<int> FtpServer::handle_pasv(std::string_view ip) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  // 分配一个新的套接字用于数据传输
-  int data_fd = socket(AF_INET, SOCK_STREAM, 0);
+  // 关闭尚未使用或块模式下保持的数据连接
+  release_data(ip);
+  // 分配一个新的套接字用于数据传输，非阻塞以便协程等待连接
+  int data_fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (data_fd < 0) {
     std::cerr << "Failed to create data socket" << std::endl;
-    return SERVER_INNER_ERROR;
+    co_return SERVER_INNER_ERROR;
   }
-  // 绑定套接字到地址
+  // 在配置的端口范围内绑定套接字
+  auto cfg = Config::get();
+  int reuse = 1;
+  setsockopt(data_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
   sockaddr_in data_addr;
   data_addr.sin_family = AF_INET;
   data_addr.sin_addr.s_addr = INADDR_ANY;
-  data_addr.sin_port = 0; // 让系统自动分配端口
-  if (bind(data_fd, (struct sockaddr *)&data_addr, sizeof(data_addr)) < 0) {
+  bool bound = false;
+  for (int port = cfg->min_port; port <= cfg->max_port; port++) {
+    data_addr.sin_port = htons(port);
+    if (bind(data_fd, (struct sockaddr *)&data_addr, sizeof(data_addr)) == 0) {
+      bound = true;
+      break;
+    }
+  }
+  if (!bound) {
     std::cerr << "Bind failed" << std::endl;
     close(data_fd);
-    return SERVER_INNER_ERROR;
-  }
-  // 更新客户端信息
-  {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    clients[std::string(ip)].data_fd = data_fd;
-    clients[std::string(ip)].is_positive = false; // 设置为被动模式
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-
   // 开始监听数据连接
   if (listen(data_fd, 1) < 0) {
     std::cerr << "Listen failed" << std::endl;
     close(data_fd);
-    std::string error_msg = "425 Cannot open data connection\r\n";
-    send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-         error_msg.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
   }
 
   // 获取分配的端口号
@@ -560,94 +1140,484 @@ int FtpServer::handle_pasv(std::string_view ip) {
   if (getsockname(data_fd, (struct sockaddr *)&data_addr, &addr_len) < 0) {
     std::cerr << "Get socket name failed: " << strerror(errno) << std::endl;
     close(data_fd);
-    std::string error_msg = "425 Cannot open data connection\r\n";
-    send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-         error_msg.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
   }
   int port = ntohs(data_addr.sin_port);
+  // 监听就绪后才记入会话，失败时会话中不会留下已关闭的描述符
+  client(ip).data_fd = data_fd;
+  client(ip).is_positive = false; // 设置为被动模式
 
-  std::string response =
-      std::format("227 Entering Passive Mode (127,0,0,1,{},{})\r\n", port / 256,
-                  port % 256);
+  std::pmr::string response(arena(ip));
+  std::format_to(std::back_inserter(response),
+                 "227 Entering Passive Mode (127,0,0,1,{},{})\r\n", port / 256,
+                 port % 256);
   std::cout << "Passive mode: " << response << std::endl;
+  client(ip).pasv_ready = Recorder::now();
   // 发送响应
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
+  co_await reply(ip, response);
   std::cout << "Data connection established" << std::endl;
-  return COMMON;
+  co_return COMMON;
 }
 
-int FtpServer::handle_epsv(std::string_view ip) {
-  std::string response = "500 Not Provided\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
+Task<int> FtpServer::handle_epsv(std::string_view ip) {
+  co_await reply(ip, "500 Not Provided\r\n");
+  co_return COMMON;
 }
 
-int FtpServer::handle_type(std::string_view ip) {
+Task<int> FtpServer::handle_type(std::string_view ip) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
-  std::string response = "200 Type set to I\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
+  co_await reply(ip, "200 Type set to I\r\n");
+  co_return COMMON;
 }
 
-int FtpServer::handle_error(std::string_view ip) {
+Task<int> FtpServer::handle_error(std::string_view ip) {
   std::cerr << "Unknown command" << std::endl;
-  std::string error_msg = "500 Unknown command\r\n";
-  send(clients[std::string(ip)].client_fd, error_msg.c_str(), error_msg.size(),
-       0);
-  return SERVER_INNER_ERROR;
+  co_await reply(ip, "500 Unknown command\r\n");
+  co_return SERVER_INNER_ERROR;
+}
+
+// 参数不区分大小写比较
+static bool equals_ignore_case(std::string_view a, std::string_view b) {
+  return std::ranges::equal(a, b, [](char x, char y) {
+    return std::toupper((unsigned char)x) == std::toupper((unsigned char)y);
+  });
+}
+
+Task<int> FtpServer::handle_auth(std::string_view ip,
+                                 std::string_view mechanism) {
+  if (!Tls::enabled()) {
+    co_await reply(ip, "502 TLS not configured\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (!equals_ignore_case(mechanism, "TLS") &&
+      !equals_ignore_case(mechanism, "SSL") &&
+      !equals_ignore_case(mechanism, "TLS-C")) {
+    co_await reply(ip, "504 Unsupported security mechanism\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (client(ip).ssl != nullptr) {
+    co_await reply(ip, "503 TLS already active\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await reply(ip, "234 Proceed with negotiation\r\n");
+  SSL *ssl = co_await Tls::accept(client(ip).client_fd);
+  if (ssl == nullptr) {
+    // 握手失败后控制连接状态未知，直接断开
+    shutdown(client(ip).client_fd, SHUT_RDWR);
+    co_return SERVER_INNER_ERROR;
+  }
+  client(ip).ssl = ssl;
+  // RFC 4217：安全连接建立后需重新登陆，明文阶段发送的 USER 也作废
+  {
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    if (it != users.end()) {
+      users.erase(it);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(login_status_mutex);
+    login_status.erase(std::string(ip));
+  }
+  co_return COMMON;
+}
+
+Task<int> FtpServer::handle_pbsz(std::string_view ip, std::string_view size) {
+  if (client(ip).ssl == nullptr) {
+    co_await reply(ip, "503 Use AUTH TLS first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 参数须为十进制数；流式 TLS 不需要保护缓冲区，按 RFC 4217 总是应答 0
+  uint64_t value = 0;
+  auto result = std::from_chars(size.data(), size.data() + size.size(), value);
+  if (size.empty() || result.ec != std::errc() ||
+      result.ptr != size.data() + size.size()) {
+    co_await reply(ip, "501 Invalid protection buffer size\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  client(ip).pbsz = true;
+  co_await reply(ip, "200 PBSZ=0\r\n");
+  co_return COMMON;
 }
 
-int FtpServer::handle_port(std::string_view ip, std::string_view path) {
+Task<int> FtpServer::handle_prot(std::string_view ip, std::string_view level) {
+  if (!client(ip).pbsz) {
+    co_await reply(ip, "503 Use PBSZ first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (equals_ignore_case(level, "P")) {
+    client(ip).protect_data = true;
+    co_await reply(ip, "200 Protection level set to Private\r\n");
+    co_return COMMON;
+  }
+  if (equals_ignore_case(level, "C")) {
+    if (Config::get()->tls_required) {
+      co_await reply(ip, "534 Data connections must be encrypted\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    client(ip).protect_data = false;
+    co_await reply(ip, "200 Protection level set to Clear\r\n");
+    co_return COMMON;
+  }
+  co_await reply(ip, "504 Protection level not supported\r\n");
+  co_return SERVER_INNER_ERROR;
+}
+
+// MODE S 为默认的流模式，MODE B 为块模式（RFC 959）
+// 块模式下文件以 EOF 块结束，数据连接在传输之间保持打开
+Task<int> FtpServer::handle_mode(std::string_view ip, std::string_view mode) {
+  if (!logged_in(ip)) {
+    co_await reply(ip, "530 Not logged in\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (equals_ignore_case(mode, "B")) {
+    client(ip).block_mode = true;
+    co_await reply(ip, "200 Mode set to B\r\n");
+    co_return COMMON;
+  }
+  if (equals_ignore_case(mode, "S")) {
+    // 流模式以关闭连接表示文件结束，不能沿用保持的连接
+    if (client(ip).data_open) {
+      release_data(ip);
+    }
+    client(ip).block_mode = false;
+    co_await reply(ip, "200 Mode set to S\r\n");
+    co_return COMMON;
+  }
+  co_await reply(ip, "504 Mode not supported\r\n");
+  co_return SERVER_INNER_ERROR;
+}
+
+// 重启标记为文件偏移的十进制文本，流模式下同样可用于续传
+Task<int> FtpServer::handle_rest(std::string_view ip, std::string_view marker) {
+  if (!logged_in(ip)) {
+    co_await reply(ip, "530 Not logged in\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  uint64_t offset = 0;
+  auto result =
+      std::from_chars(marker.data(), marker.data() + marker.size(), offset);
+  if (marker.empty() || result.ec != std::errc() ||
+      result.ptr != marker.data() + marker.size()) {
+    co_await reply(ip, "501 Invalid restart marker\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  client(ip).restart = offset;
+  std::pmr::string response(arena(ip));
+  std::format_to(std::back_inserter(response),
+                 "350 Restarting at {}. Send RETR to resume\r\n", offset);
+  co_await reply(ip, response);
+  co_return COMMON;
+}
+
+Task<int> FtpServer::handle_port(std::string_view ip, std::string_view path) {
   // 检查登陆状态
-  if (login_status[std::string(ip)] == false) {
+  if (!logged_in(ip)) {
     std::cerr << "User not logged in" << std::endl;
-    std::string mess = "Please login first\r\n";
-    send(clients[std::string(ip)].client_fd, mess.c_str(), mess.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "Please login first\r\n");
+    co_return SERVER_INNER_ERROR;
   }
+  release_data(ip);
   auto res = Parser::parse_path(path);
   auto data_ip = res.first;
   auto data_port = res.second;
   std::cout << "Data IP: " << data_ip << ", Data first: " << data_port / 256
             << ", Data second: " << data_port % 256 << std::endl;
-  int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int server_fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (server_fd == CREATE_SOCKET_ERROR) {
     std::cerr << "Failed to create socket" << std::endl;
-    return CREATE_SOCKET_ERROR;
+    co_return CREATE_SOCKET_ERROR;
   }
   sockaddr_in data_addr;
   data_addr.sin_family = AF_INET;
   data_addr.sin_addr.s_addr = inet_addr(data_ip.c_str());
   data_addr.sin_port = htons(data_port); // 端口号
-  if (connect(server_fd, (struct sockaddr *)&data_addr, sizeof(data_addr)) <
-      0) {
+  if (co_await Executor::async_connect(server_fd, data_addr) < 0) {
     std::cerr << "Failed to connect to data port" << std::endl;
     close(server_fd);
-    std::string error_msg = "425 Cannot open data connection\r\n";
-    send(clients[std::string(ip)].client_fd, error_msg.c_str(),
-         error_msg.size(), 0);
-    return SERVER_INNER_ERROR;
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
   }
   // 更新客户端信息
-  {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    clients[std::string(ip)].data_fd = server_fd;
-    clients[std::string(ip)].is_positive = true; // 设置为主动模式
-  }
+  client(ip).data_fd = server_fd;
+  client(ip).is_positive = true; // 设置为主动模式
 
   // 主动模式
-  std::string response = "200 PORT command successful\r\n";
-  send(clients[std::string(ip)].client_fd, response.c_str(), response.size(),
-       0);
-  return COMMON;
-}
\ No newline at end of file
+  co_await reply(ip, "200 PORT command successful\r\n");
+  co_return COMMON;
+}
+
+// 站点命令：
+//   SITE FIND <通配符>     在当前目录下递归查找，结果经数据连接返回
+//   SITE DUMP              经数据连接返回飞行记录，仅限 admin_user
+// 去重存储的上传协商：
+//   SITE HAVE <摘要> ...   逐个回答是否已有该块，200 后每个摘要一位，1 为已有
+//   SITE CHUNK <摘要>      经数据连接上传一个块，内容须与摘要相符
+//   SITE COMMIT <路径>     经数据连接上传清单，所引用的块都存在时创建文件
+Task<int> FtpServer::handle_site(std::string_view ip, std::string_view args) {
+  // 检查登陆状态
+  if (!logged_in(ip)) {
+    co_await reply(ip, "530 Not logged in\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  size_t space = args.find(' ');
+  std::string_view name = args.substr(0, space);
+  std::string_view param =
+      space == std::string_view::npos ? "" : args.substr(space + 1);
+  if (equals_ignore_case(name, "FIND")) {
+    co_return co_await handle_find(ip, param);
+  }
+  if (equals_ignore_case(name, "DUMP")) {
+    co_return co_await handle_dump(ip);
+  }
+  auto dedup = std::dynamic_pointer_cast<DedupStorage>(Storage::get());
+  if (dedup == nullptr) {
+    co_await reply(ip, "502 Deduplication is not enabled\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (equals_ignore_case(name, "HAVE")) {
+    std::pmr::string response(arena(ip));
+    response.append("200 ");
+    while (!param.empty()) {
+      size_t end = param.find(' ');
+      std::string_view hash = param.substr(0, end);
+      if (!hash.empty()) {
+        response.push_back(dedup->has_chunk(hash) ? '1' : '0');
+      }
+      param.remove_prefix(end == std::string_view::npos ? param.size()
+                                                        : end + 1);
+    }
+    response.append("\r\n");
+    co_await reply(ip, response);
+    co_return COMMON;
+  }
+  if (equals_ignore_case(name, "CHUNK")) {
+    if (param.empty()) {
+      co_await reply(ip, "501 Missing chunk hash\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    std::string data;
+    if (co_await recv_upload(ip, data, DedupStorage::CHUNK_LIMIT) != COMMON) {
+      co_return SERVER_INNER_ERROR;
+    }
+    bool stored = !data.empty() && co_await Executor::blocking([&] {
+      return !dedup->store_chunk(data.data(), data.size(), param).empty();
+    });
+    if (!stored) {
+      co_await reply(ip, "550 Chunk does not match its hash\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    co_await complete(ip, "Chunk stored");
+    co_return COMMON;
+  }
+  if (equals_ignore_case(name, "COMMIT")) {
+    if (param.empty()) {
+      co_await reply(ip, "501 Missing file name\r\n");
+      co_return SERVER_INNER_ERROR;
+    }
+    std::string manifest;
+    if (co_await recv_upload(ip, manifest, DedupStorage::MANIFEST_LIMIT) !=
+        COMMON) {
+      co_return SERVER_INNER_ERROR;
+    }
+    auto &session = client(ip);
+    if (!co_await Executor::blocking([&] {
+          return dedup->commit_manifest(session, param, manifest);
+        })) {
+      int error = errno;
+      std::cerr << "Failed to commit " << param << ": " << strerror(error)
+                << std::endl;
+      if (error == EINVAL) {
+        co_await reply(ip, "501 Invalid manifest\r\n");
+      } else if (error == ENODATA) {
+        co_await reply(ip, "550 Manifest references missing chunks\r\n");
+      } else {
+        co_await reply(ip, "553 Could not create file\r\n");
+      }
+      co_return SERVER_INNER_ERROR;
+    }
+    co_await complete(ip, "File committed");
+    std::cout << "File " << param << " committed from " << ip << std::endl;
+    co_return COMMON;
+  }
+  co_await reply(ip, "501 Unknown SITE command\r\n");
+  co_return SERVER_INNER_ERROR;
+}
+
+// 经数据连接接收不超过 limit 字节的完整内容，出错时已向客户端应答
+Task<int> FtpServer::recv_upload(std::string_view ip, std::string &data,
+                                 size_t limit) {
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (Config::get()->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await reply(ip, "150 Ok to send data\r\n");
+  SSL *data_ssl = nullptr;
+  int data_fd = co_await accept_data(ip, data_ssl);
+  if (data_fd < 0) {
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 多接收一个字节用于判断是否超限
+  data.resize(std::min<size_t>(limit + 1, 64 * 1024));
+  BlockReader reader;
+  BlockReader *blocks = client(ip).block_mode ? &reader : nullptr;
+  auto &trace = client(ip).trace;
+  size_t total = 0;
+  ssize_t bytes_received = 0;
+  while ((bytes_received = co_await recv_content(data_fd, data_ssl, blocks,
+                                                 data.data() + total,
+                                                 data.size() - total)) > 0) {
+    if (total == 0) {
+      trace.mark(Recorder::FIRST_BYTE);
+    }
+    trace.add_bytes(bytes_received);
+    total += bytes_received;
+    if (total > limit) {
+      break;
+    }
+    if (total == data.size()) {
+      data.resize(std::min(limit + 1, data.size() * 2));
+    }
+  }
+  trace.mark(Recorder::LAST_BYTE);
+  finish_data(ip, data_fd, data_ssl, bytes_received == 0);
+  if (bytes_received < 0) {
+    co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (total > limit) {
+    co_await reply(ip, "552 Exceeded storage allocation\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  data.resize(total);
+  co_return COMMON;
+}
+
+// 由索引回答，不访问磁盘；通配符含 / 时匹配相对当前目录的路径，否则匹配名称
+Task<int> FtpServer::handle_find(std::string_view ip,
+                                 std::string_view pattern) {
+  if (pattern.empty()) {
+    co_await reply(ip, "501 Missing pattern\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (Config::get()->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (!Index::ready()) {
+    co_await reply(ip, "450 Index not available\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  std::string glob(pattern);
+  bool match_path = pattern.find('/') != std::string_view::npos;
+  std::pmr::string base(arena(ip));
+  Path::normalize(client(ip).curr_path, "", base);
+  std::string result;
+  size_t matches = 0;
+  bool found = Index::walk(base, [&](std::string_view dir,
+                                     const Index::Node &node) {
+    std::string path(dir);
+    for (auto &[name, child] : node.children) {
+      path.resize(dir.size());
+      if (!dir.empty()) {
+        path.push_back('/');
+      }
+      path.append(name);
+      int flags = match_path ? FNM_PATHNAME : 0;
+      if (fnmatch(glob.c_str(), match_path ? path.c_str() : name.c_str(),
+                  flags) == 0) {
+        result.append(base).append(base.size() > 1 ? "/" : "");
+        result.append(path).append(child.dir ? "/\r\n" : "\r\n");
+        matches++;
+      }
+    }
+  });
+  if (!found) {
+    co_await reply(ip, "550 Failed to open directory\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  co_await reply(ip, "150 Here comes the search result\r\n");
+  SSL *data_ssl = nullptr;
+  int data_fd = co_await accept_data(ip, data_ssl);
+  if (data_fd < 0) {
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  ssize_t bytes_sent =
+      co_await send_content(data_fd, data_ssl, result.data(), result.size(),
+                            client(ip).block_mode, client(ip).trace);
+  finish_data(ip, data_fd, data_ssl, bytes_sent >= 0);
+  if (bytes_sent < 0) {
+    co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  std::pmr::string message(arena(ip));
+  std::format_to(std::back_inserter(message), "{} matches", matches);
+  co_await complete(ip, message);
+  co_return COMMON;
+}
+
+// 与 SIGUSR1 写出的文件格式相同，可直接交给 recdump 解码
+Task<int> FtpServer::handle_dump(std::string_view ip) {
+  auto cfg = Config::get();
+  // 已登录时 users 中即是通过 PASS 认证的帐号
+  bool admin = logged_in(ip) && !cfg->admin_user.empty();
+  if (admin) {
+    std::lock_guard<std::mutex> lock(users_mutex);
+    auto it = users.find(ip);
+    admin = it != users.end() && it->second == cfg->admin_user;
+  }
+  if (!admin) {
+    co_await reply(ip, "550 Permission denied\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  // 检查数据连接是否可用
+  if (client(ip).data_fd == -1) {
+    co_await reply(ip, "425 Use PASV first\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  if (cfg->tls_required && !client(ip).protect_data) {
+    co_await reply(ip, "521 Data connections must be encrypted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  std::string records = Recorder::dump();
+  co_await reply(ip, "150 Here comes the flight recorder\r\n");
+  SSL *data_ssl = nullptr;
+  int data_fd = co_await accept_data(ip, data_ssl);
+  if (data_fd < 0) {
+    co_await reply(ip, "425 Cannot open data connection\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  ssize_t bytes_sent =
+      co_await send_content(data_fd, data_ssl, records.data(), records.size(),
+                            client(ip).block_mode, client(ip).trace);
+  finish_data(ip, data_fd, data_ssl, bytes_sent >= 0);
+  if (bytes_sent < 0) {
+    co_await reply(ip, "426 Connection closed; transfer aborted\r\n");
+    co_return SERVER_INNER_ERROR;
+  }
+  std::pmr::string message(arena(ip));
+  std::format_to(std::back_inserter(message), "{} records",
+                 (records.size() - sizeof(Recorder::FileHeader)) /
+                     sizeof(Recorder::Record));
+  co_await complete(ip, message);
+  co_return COMMON;
+}
@@ -1,5 +1,11 @@
 #pragma once
+#include "block.hpp"
+#include "buffer.hpp"
 #include "define.hpp"
+#include "storage.hpp"
+#include "task.hpp"
+#include <atomic>
+#include <memory_resource>
 #include <mutex>
 #include <string_view>
 #include <unordered_map>
@@ -8,8 +14,11 @@ namespace ftp {
 
 class FtpServer {
 public:
-  static void start();
+  // upgrade 为 true 时从旧进程接管监听套接字
+  static void start(bool upgrade = false);
   static void stop();
+  // 在事件循环上处理一个已建立的非阻塞控制连接
+  static void serve(const sockaddr_in &address, int client_fd);
 
 private:
   FtpServer() = default;
@@ -19,41 +28,104 @@ private:
   FtpServer &operator=(const FtpServer &) = delete;
   FtpServer &operator=(FtpServer &&) = delete;
 
-  static int handle_client(sockaddr_in &address,
-                           int client_fd); // 分配线程处理客户端请求
-  static int handle_user(std::string_view ip,
-                         std::string_view username); // 记录用户登录
-  static int handle_pass(std::string_view ip,
-                         std::string_view password); // 校验用户密码
-  static int handle_list(std::string_view ip,
-                         std::string_view path); // 列出文件
-  static int handle_get(std::string_view ip,
-                        std::string_view path); // 下载文件
-  static int handle_pwd(std::string_view ip,
-                        std::string_view path); // 显示当前目录
-  static int handle_lcd(std::string_view ip,
-                        std::string_view path); // 切换目录
-  static int handle_port(std::string_view ip,
-                         std::string_view path); // 主动模式
-  static int handle_syst(std::string_view ip);   // 显示系统信息
-  static int handle_pasv(std::string_view ip);   // 主动模式
-  static int handle_epsv(std::string_view ip);   // 被动模式
-  static int handle_quit(std::string_view ip);   // 退出登录
-  static int handle_type(std::string_view ip);   // 设置传输类型
-  static int handle_error(std::string_view ip);  // 处理错误
+  static Client &client(std::string_view ip); // 查找会话信息
+  static bool logged_in(std::string_view ip);  // 是否已登陆
+  static Task<int> reply(std::string_view ip,
+                         std::string_view message); // 向控制连接发送应答
+  static std::pmr::memory_resource *
+  arena(std::string_view ip);     // 当前命令可用的临时内存
+  static int create_listener();   // 创建并绑定监听套接字
+  static void drain(int timeout); // 等待会话结束，超时后强制关闭
+  static Task<int> handle_client(sockaddr_in address,
+                                 int client_fd); // 协程处理客户端请求
+  static Task<ssize_t> recv_line(int fd, SSL *ssl, Buffer &buffer,
+                                 size_t &buffered,
+                                 std::pmr::string &line); // 读取一行命令
+  static Task<int> accept_data(std::string_view ip,
+                               SSL *&ssl); // 获取数据连接
+  static Task<ssize_t> send_data(int data_fd, SSL *ssl, const char *data,
+                                 size_t size); // 发送数据
+  static Task<ssize_t> recv_data(int data_fd, SSL *ssl, char *data,
+                                 size_t size); // 接收数据
+  static Task<ssize_t> send_file(int data_fd, SSL *ssl, ReadFile &file,
+                                 size_t chunk_size, size_t offset, bool block,
+                                 Recorder::Trace &trace); // 发送文件内容
+  static Task<ssize_t>
+  send_content(int data_fd, SSL *ssl, const char *data, size_t size,
+               bool block, Recorder::Trace &trace); // 发送列表等完整内容
+  static Task<ssize_t> recv_content(int data_fd, SSL *ssl,
+                                    BlockReader *reader, char *data,
+                                    size_t size); // 接收上传内容
+  static void close_data(int data_fd, SSL *ssl);  // 关闭数据连接
+  static void finish_data(std::string_view ip, int data_fd, SSL *ssl,
+                          bool ok); // 传输结束，块模式下保持数据连接
+  static void release_data(std::string_view ip); // 关闭会话的数据连接
+  static Task<int> complete(std::string_view ip,
+                            std::string_view message); // 应答传输完成
+  static Task<int> handle_user(std::string_view ip,
+                               std::string_view username); // 记录用户登录
+  static Task<int> handle_pass(std::string_view ip,
+                               std::string_view password); // 校验用户密码
+  static Task<int> handle_list(std::string_view ip,
+                               std::string_view path); // 列出文件
+  static Task<int> handle_get(std::string_view ip,
+                              std::string_view path); // 下载文件
+  static Task<int> handle_put(std::string_view ip,
+                              std::string_view path); // 上传文件
+  static Task<int> handle_pwd(std::string_view ip,
+                              std::string_view path); // 显示当前目录
+  static Task<int> handle_lcd(std::string_view ip,
+                              std::string_view path); // 切换目录
+  static Task<int> handle_port(std::string_view ip,
+                               std::string_view path); // 主动模式
+  static Task<int> handle_syst(std::string_view ip); // 显示系统信息
+  static Task<int> handle_pasv(std::string_view ip); // 主动模式
+  static Task<int> handle_epsv(std::string_view ip); // 被动模式
+  static Task<int> handle_quit(std::string_view ip); // 退出登录
+  static Task<int> handle_type(std::string_view ip); // 设置传输类型
+  static Task<int> handle_error(std::string_view ip); // 处理错误
+  static Task<int> handle_auth(std::string_view ip,
+                               std::string_view mechanism); // 升级为 TLS
+  static Task<int> handle_pbsz(std::string_view ip,
+                               std::string_view size); // 协商保护缓冲区大小
+  static Task<int> handle_prot(std::string_view ip,
+                               std::string_view level); // 设置数据连接保护级别
+  static Task<int> handle_site(std::string_view ip,
+                               std::string_view args); // 站点命令（去重上传）
+  static Task<int> handle_mode(std::string_view ip,
+                               std::string_view mode); // 设置传输模式
+  static Task<int> handle_rest(std::string_view ip,
+                               std::string_view marker); // 设置下载起点
+  static Task<int> handle_dump(std::string_view ip); // 取回飞行记录
+  static Task<int> handle_find(std::string_view ip,
+                               std::string_view pattern); // 按通配符查找文件
+  static Task<int> recv_upload(std::string_view ip, std::string &data,
+                               size_t limit); // 接收整个上传内容
 private:
-  // IP 与 用户名的映射
-  static std::unordered_map<std::string, std::string> users;
+  // 会话标识（IP:端口）与 用户名的映射
+  static std::unordered_map<std::string, std::string, StringHash,
+                            std::equal_to<>>
+      users;
   // 保护 users 的互斥锁
   static std::mutex users_mutex;
-  // IP 与 客户端信息的映射
-  static std::unordered_map<std::string, Client> clients;
+  // 会话标识与 客户端信息的映射
+  static std::unordered_map<std::string, Client, StringHash, std::equal_to<>>
+      clients;
   // 保护 clients 的互斥锁
   static std::mutex clients_mutex;
   // 登陆状态
-  static std::unordered_map<std::string, bool> login_status;
+  static std::unordered_map<std::string, bool, StringHash, std::equal_to<>>
+      login_status;
   // 保护 login_status 的互斥锁
   static std::mutex login_status_mutex;
+  // 当前会话数
+  static std::atomic<int> active_sessions;
+  // 上一个分配的会话编号
+  static std::atomic<uint64_t> last_session;
+  // 是否已交出监听套接字
+  static std::atomic<bool> draining;
+  // 唤醒 accept 循环的管道
+  static int wake_fds[2];
 };
 
 } // namespace ftp
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "storage.hpp"
+#include "config.hpp"
+#include "dedup.hpp"
+#include "path.hpp"
+#include "tiered.hpp"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ftp;
+
+inline std::atomic<std::shared_ptr<Storage>> Storage::current;
+
+namespace {
+
+// 先写入同目录下的临时文件，提交时重命名为目标文件
+class LocalWriteFile : public WriteFile {
+public:
+  LocalWriteFile(std::shared_ptr<DirHandle> dir, std::string temp_name,
+                 std::string name, int fd)
+      : dir(std::move(dir)), temp_name(std::move(temp_name)),
+        name(std::move(name)), fd(fd) {}
+
+  ~LocalWriteFile() override {
+    if (fd >= 0) {
+      close(fd);
+      unlinkat(dir->fd(), temp_name.c_str(), 0);
+    }
+  }
+
+  ssize_t write(const char *data, size_t size) override {
+    size_t total = 0;
+    while (total < size) {
+      ssize_t n = ::write(fd, data + total, size - total);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      total += n;
+    }
+    return total;
+  }
+
+  bool commit() override {
+    if (close(std::exchange(fd, -1)) < 0 ||
+        renameat(dir->fd(), temp_name.c_str(), dir->fd(), name.c_str()) < 0) {
+      unlinkat(dir->fd(), temp_name.c_str(), 0);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  std::shared_ptr<DirHandle> dir; // 目标目录
+  std::string temp_name;          // 临时文件名
+  std::string name;               // 目标文件名
+  int fd;                         // 临时文件描述符
+};
+
+} // namespace
+
+ReadFile::~ReadFile() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+// 普通文件的内容已全部可读
+Task<ssize_t> ReadFile::readable(size_t) { co_return size_; }
+
+ssize_t ReadFile::read(char *data, size_t size, size_t offset) {
+  return pread(fd_, data, size, offset);
+}
+
+bool Storage::reload() {
+  auto cfg = Config::get();
+  auto storage = current.load();
+  if (storage != nullptr) {
+    // 存储后端切换需要重启，缓存大小等参数由后端按快照实时读取
+    return true;
+  }
+  if (cfg->storage == "local") {
+    storage = std::make_shared<LocalStorage>();
+  } else if (cfg->storage == "tiered") {
+    storage = TieredStorage::create(cfg->cache_path);
+  } else if (cfg->storage == "dedup") {
+    storage = DedupStorage::create(cfg->dedup_path);
+  } else {
+    std::cerr << "Unknown storage: " << cfg->storage << std::endl;
+  }
+  if (storage == nullptr) {
+    return false;
+  }
+  current.store(std::move(storage));
+  std::cout << "Using " << cfg->storage << " storage" << std::endl;
+  return true;
+}
+
+std::shared_ptr<Storage> Storage::get() { return current.load(); }
+
+std::unique_ptr<ReadFile> LocalStorage::open_read(const Client &session,
+                                                  std::string_view path) {
+  return open_file(Path::open(session, path, O_RDONLY));
+}
+
+std::unique_ptr<ReadFile> LocalStorage::open_read_beneath(int dir_fd,
+                                                          const char *path) {
+  return open_file(Path::open_beneath(dir_fd, path, O_RDONLY));
+}
+
+std::unique_ptr<ReadFile> LocalStorage::open_file(int fd) {
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    close(fd);
+    errno = EISDIR;
+    return nullptr;
+  }
+  return std::make_unique<ReadFile>(fd, file_stat.st_size);
+}
+
+std::unique_ptr<WriteFile> LocalStorage::open_write(const Client &session,
+                                                    std::string_view path) {
+  static std::atomic<uint64_t> upload_id = 0;
+  std::pmr::string name(session.arena);
+  auto dir = Path::open_parent(session, path, name);
+  if (dir == nullptr) {
+    return nullptr;
+  }
+  std::string temp_name = "." + std::string(name) + ".upload." +
+                          std::to_string(getpid()) + "." +
+                          std::to_string(upload_id.fetch_add(1));
+  int fd = Path::open_beneath(dir->fd(), temp_name.c_str(),
+                              O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    return nullptr;
+  }
+  return std::make_unique<LocalWriteFile>(std::move(dir), std::move(temp_name),
+                                          std::string(name), fd);
+}
+
+int LocalStorage::open_dir(const Client &session, std::string_view path) {
+  return Path::open(session, path, O_RDONLY | O_DIRECTORY);
+}
+
+int LocalStorage::stat_at(int dir_fd, const char *name, struct stat &status) {
+  return fstatat(dir_fd, name, &status, AT_SYMLINK_NOFOLLOW);
+}
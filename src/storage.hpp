@@ -0,0 +1,109 @@
+#pragma once
+#include "define.hpp"
+#include "task.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace ftp {
+
+class DirHandle;
+
+// 打开的待下载文件
+class ReadFile {
+public:
+  ReadFile(int fd, size_t size) : fd_(fd), size_(size) {}
+  virtual ~ReadFile();
+  ReadFile(const ReadFile &) = delete;
+  ReadFile(ReadFile &&) = delete;
+  ReadFile &operator=(const ReadFile &) = delete;
+  ReadFile &operator=(ReadFile &&) = delete;
+
+  size_t size() const { return size_; }
+  // 可用于 sendfile 的文件描述符，不支持时为 -1
+  int fd() const { return fd_; }
+  // 等待 offset 处有数据可读，返回当前可读范围的末尾，失败返回 -1
+  virtual Task<ssize_t> readable(size_t offset);
+  // 读取 offset 处的数据到缓冲区，fd() 为 -1 时由它提供内容
+  virtual ssize_t read(char *data, size_t size, size_t offset);
+
+protected:
+  int fd_;      // 文件描述符
+  size_t size_; // 文件大小
+};
+
+// 打开的待上传文件，commit 之前对其他会话不可见，未提交时析构即丢弃
+class WriteFile {
+public:
+  WriteFile() = default;
+  virtual ~WriteFile() = default;
+  WriteFile(const WriteFile &) = delete;
+  WriteFile(WriteFile &&) = delete;
+  WriteFile &operator=(const WriteFile &) = delete;
+  WriteFile &operator=(WriteFile &&) = delete;
+
+  // 追加数据，失败返回 -1
+  virtual ssize_t write(const char *data, size_t size) = 0;
+  // 完成上传，文件原子地出现在目标路径
+  virtual bool commit() = 0;
+};
+
+// 存储后端接口，文件传输与目录列表经由它访问数据
+// 路径均相对会话当前目录解析，不能越出根目录
+class Storage {
+public:
+  Storage() = default;
+  virtual ~Storage() = default;
+  Storage(const Storage &) = delete;
+  Storage(Storage &&) = delete;
+  Storage &operator=(const Storage &) = delete;
+  Storage &operator=(Storage &&) = delete;
+
+  // 按配置创建存储后端，后端类型与缓存目录仅启动时生效
+  static bool reload();
+  // 当前存储后端
+  static std::shared_ptr<Storage> get();
+
+  // 结束后台任务，在事件循环停止后调用
+  virtual void stop() {}
+
+  // 打开待下载的文件，失败返回 nullptr 并设置 errno
+  virtual std::unique_ptr<ReadFile> open_read(const Client &session,
+                                              std::string_view path) = 0;
+  // 打开 dir_fd 下的文件，内容可立即读取（不经过读缓存），用于批量打包
+  virtual std::unique_ptr<ReadFile> open_read_beneath(int dir_fd,
+                                                      const char *path) = 0;
+  // 打开待上传的文件，失败返回 nullptr 并设置 errno
+  virtual std::unique_ptr<WriteFile> open_write(const Client &session,
+                                                std::string_view path) = 0;
+  // 打开待列出的目录，返回可读的目录 fd，失败返回 -1
+  virtual int open_dir(const Client &session, std::string_view path) = 0;
+  // 目录列表中一项的属性，大小为下载时得到的字节数，失败返回 -1
+  virtual int stat_at(int dir_fd, const char *name, struct stat &status) = 0;
+
+private:
+  // 当前存储后端
+  static std::atomic<std::shared_ptr<Storage>> current;
+};
+
+// 直接读写根目录
+class LocalStorage : public Storage {
+public:
+  std::unique_ptr<ReadFile> open_read(const Client &session,
+                                      std::string_view path) override;
+  std::unique_ptr<ReadFile> open_read_beneath(int dir_fd,
+                                              const char *path) override;
+  std::unique_ptr<WriteFile> open_write(const Client &session,
+                                        std::string_view path) override;
+  int open_dir(const Client &session, std::string_view path) override;
+  int stat_at(int dir_fd, const char *name, struct stat &status) override;
+
+protected:
+  // 把已打开的文件包装为 ReadFile，fd 为 -1 或不是普通文件时返回 nullptr
+  virtual std::unique_ptr<ReadFile> open_file(int fd);
+};
+
+} // namespace ftp
@@ -0,0 +1,142 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <variant>
+
+namespace ftp {
+
+// 协程帧分配器
+// 小帧按 64 字节分级缓存在线程本地空闲链表中，稳态下 co_await 不触发堆分配
+class FrameAllocator {
+public:
+  static void *allocate(size_t size) {
+    size_t index = (size + GRANULARITY - 1) / GRANULARITY;
+    if (index >= CLASS_COUNT) {
+      return ::operator new(size);
+    }
+    FreeNode *node = free_lists[index];
+    if (node != nullptr) {
+      free_lists[index] = node->next;
+      return node;
+    }
+    return ::operator new(index * GRANULARITY);
+  }
+
+  static void deallocate(void *ptr, size_t size) {
+    size_t index = (size + GRANULARITY - 1) / GRANULARITY;
+    if (index >= CLASS_COUNT) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto node = static_cast<FreeNode *>(ptr);
+    node->next = free_lists[index];
+    free_lists[index] = node;
+  }
+
+private:
+  FrameAllocator() = default;
+  ~FrameAllocator() = default;
+  FrameAllocator(const FrameAllocator &) = delete;
+  FrameAllocator(FrameAllocator &&) = delete;
+  FrameAllocator &operator=(const FrameAllocator &) = delete;
+  FrameAllocator &operator=(FrameAllocator &&) = delete;
+
+  struct FreeNode {
+    FreeNode *next;
+  };
+  static constexpr size_t GRANULARITY = 64;
+  static constexpr size_t CLASS_COUNT = 64; // 缓存 4KiB 以下的帧
+
+  static inline thread_local std::array<FreeNode *, CLASS_COUNT> free_lists{};
+};
+
+// 惰性启动的协程任务，被 co_await 时才开始执行，结束后恢复等待者
+// 同步完成时等待者直接继续，不依赖编译器把对称转移优化为尾调用，
+// 未经挂起的 co_await 在循环中也不会使栈增长
+template <typename T> class Task {
+public:
+  struct promise_type;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  struct promise_type {
+    std::variant<std::monostate, T, std::exception_ptr> result;
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    // 任务结束与等待者挂起中后发生的一方负责恢复等待者
+    std::atomic<bool> ready = false;
+
+    // 等待者已挂起时对称转移到等待者，否则由等待者自己继续
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle_type handle) noexcept {
+        auto &promise = handle.promise();
+        if (promise.ready.exchange(true, std::memory_order_acq_rel)) {
+          return promise.continuation;
+        }
+        return std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+
+    static void *operator new(size_t size) {
+      return FrameAllocator::allocate(size);
+    }
+    static void operator delete(void *ptr, size_t size) {
+      FrameAllocator::deallocate(ptr, size);
+    }
+
+    Task get_return_object() { return Task(handle_type::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void return_value(T value) { result.template emplace<1>(std::move(value)); }
+    void unhandled_exception() {
+      result.template emplace<2>(std::current_exception());
+    }
+  };
+
+  Task() = default;
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> awaiting) {
+    auto &promise = handle.promise();
+    promise.continuation = awaiting;
+    handle.resume();
+    // 任务已经结束时不挂起
+    return !promise.ready.exchange(true, std::memory_order_acq_rel);
+  }
+  T await_resume() {
+    auto &result = handle.promise().result;
+    if (result.index() == 2) {
+      std::rethrow_exception(std::get<2>(result));
+    }
+    return std::move(std::get<1>(result));
+  }
+
+private:
+  explicit Task(handle_type handle) : handle(handle) {}
+
+  handle_type handle;
+};
+
+} // namespace ftp
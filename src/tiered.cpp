@@ -0,0 +1,444 @@
+#include "tiered.hpp"
+#include "buffer.hpp"
+#include "config.hpp"
+#include "executor.hpp"
+#include "path.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <coroutine>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <format>
+#include <iostream>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using namespace ftp;
+
+// 每复制这么多字节通知一次等待中的读者
+static constexpr size_t FILL_STEP = 1024 * 1024;
+
+// 一次正在进行的缓存填充，由填充线程与所有读者共享
+struct TieredStorage::Fill {
+  std::mutex mutex;
+  int fd = -1;         // 缓存临时文件，读者 dup 后各自按偏移读取，受 mutex 保护
+  uint64_t size = 0;   // 文件大小
+  uint64_t filled = 0; // 已写入缓存的字节数
+  bool done = false;   // 填充完成
+  bool failed = false; // 填充失败
+  // 等待新数据的协程及其事件循环
+  std::vector<std::pair<Executor::Loop *, std::coroutine_handle<>>> waiters;
+
+  // 最后一个读者与填充线程都结束后才关闭，持有 Fill 即可随时 dup
+  ~Fill() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  // 复制缓存临时文件的描述符，尚未创建时返回 -1
+  int dup_fd() {
+    int source = -1;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      source = fd;
+    }
+    return source < 0 ? -1 : dup(source);
+  }
+
+  // 更新进度并唤醒所有等待者
+  void publish(uint64_t bytes, bool finished, bool error) {
+    std::vector<std::pair<Executor::Loop *, std::coroutine_handle<>>> waking;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      filled = bytes;
+      done = finished;
+      failed = error;
+      waking.swap(waiters);
+    }
+    for (auto [loop, handle] : waking) {
+      Executor::resume_on(loop, handle);
+    }
+  }
+
+  bool ready(uint64_t offset) const {
+    return filled > offset || done || failed;
+  }
+};
+
+// 正在填充的缓存文件，可读范围随填充进度增长
+class TieredStorage::FillingFile : public ReadFile {
+public:
+  FillingFile(int fd, size_t size, std::shared_ptr<Fill> job)
+      : ReadFile(fd, size), job(std::move(job)) {}
+
+  Task<ssize_t> readable(size_t offset) override {
+    struct Awaiter {
+      Fill *job;
+      uint64_t offset;
+      bool await_ready() {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        return job->ready(offset);
+      }
+      bool await_suspend(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (job->ready(offset)) {
+          return false;
+        }
+        job->waiters.emplace_back(Executor::current(), handle);
+        return true;
+      }
+      void await_resume() {}
+    };
+    co_await Awaiter{job.get(), offset};
+    std::lock_guard<std::mutex> lock(job->mutex);
+    co_return job->failed ? -1 : static_cast<ssize_t>(job->filled);
+  }
+
+private:
+  std::shared_ptr<Fill> job;
+};
+
+static bool write_all(int fd, const char *data, size_t size, off_t offset) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = pwrite(fd, data + total, size - total, offset + total);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    total += n;
+  }
+  return true;
+}
+
+std::shared_ptr<TieredStorage>
+TieredStorage::create(const std::string &cache_path) {
+  if (cache_path.empty()) {
+    std::cerr << "cache_path is required for tiered storage" << std::endl;
+    return nullptr;
+  }
+  mkdir(cache_path.c_str(), 0755);
+  int fd = open(cache_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Failed to open cache path " << cache_path << ": "
+              << strerror(errno) << std::endl;
+    return nullptr;
+  }
+  auto storage = std::make_shared<TieredStorage>(fd);
+  storage->scan();
+  return storage;
+}
+
+TieredStorage::~TieredStorage() {
+  stop();
+  close(cache_fd);
+}
+
+void TieredStorage::stop() {
+  std::vector<std::thread> joining;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    joining.swap(workers);
+  }
+  pending_cv.notify_all();
+  for (auto &worker : joining) {
+    worker.join();
+  }
+  std::deque<Pending> discarding;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    discarding.swap(pending);
+    for (auto &next : discarding) {
+      fills.erase(next.name);
+      used -= next.job->size;
+    }
+  }
+  for (auto &next : discarding) {
+    discard(next);
+  }
+}
+
+void TieredStorage::worker() {
+  while (true) {
+    Pending next;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      pending_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+      if (stopping) {
+        return;
+      }
+      next = std::move(pending.front());
+      pending.pop_front();
+    }
+    fill(std::move(next.job), next.src_fd, std::move(next.name));
+  }
+}
+
+void TieredStorage::discard(const Pending &next) {
+  std::string part = next.name + ".part";
+  unlinkat(cache_fd, part.c_str(), 0);
+  close(next.src_fd);
+  next.job->publish(0, false, true);
+}
+
+void TieredStorage::scan() {
+  DIR *dir = fdopendir(dup(cache_fd));
+  if (dir == nullptr) {
+    return;
+  }
+  std::vector<std::tuple<time_t, std::string, uint64_t>> files;
+  while (dirent *entry = readdir(dir)) {
+    std::string_view name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+    // 上次退出时未完成的填充
+    if (name.ends_with(".part")) {
+      unlinkat(cache_fd, entry->d_name, 0);
+      continue;
+    }
+    struct stat file_stat;
+    if (fstatat(cache_fd, entry->d_name, &file_stat, 0) == 0 &&
+        S_ISREG(file_stat.st_mode)) {
+      files.emplace_back(file_stat.st_mtime, name, file_stat.st_size);
+    }
+  }
+  closedir(dir);
+  // 修改时间即最近一次命中的时间
+  std::sort(files.begin(), files.end());
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &[mtime, name, size] : files) {
+      lru.push_front(name);
+      entries[name] = {size, lru.begin()};
+      used += size;
+    }
+    reserve(0, evicted);
+    std::cout << "Cache loaded: " << entries.size() << " files, " << used
+              << " bytes" << std::endl;
+  }
+  remove(evicted);
+}
+
+bool TieredStorage::reserve(uint64_t size,
+                            std::vector<std::string> &evicted) {
+  uint64_t capacity = static_cast<uint64_t>(Config::get()->cache_size) << 20;
+  if (size > capacity) {
+    return false;
+  }
+  while (used + size > capacity && !lru.empty()) {
+    auto it = entries.find(lru.back());
+    used -= it->second.size;
+    entries.erase(it);
+    evicted.push_back(std::move(lru.back()));
+    lru.pop_back();
+  }
+  // 剩余空间被正在进行的填充占用时不缓存
+  if (used + size > capacity) {
+    return false;
+  }
+  used += size;
+  return true;
+}
+
+void TieredStorage::remove(const std::vector<std::string> &evicted) {
+  // 正在读取的客户端仍持有文件描述符，删除不影响它们；
+  // 若同名文件在此之前已重新填充，命中时发现文件缺失会再次填充
+  for (auto &name : evicted) {
+    unlinkat(cache_fd, name.c_str(), 0);
+  }
+}
+
+std::unique_ptr<ReadFile> TieredStorage::open_read(const Client &session,
+                                                   std::string_view path) {
+  int src_fd = Path::open(session, path, O_RDONLY);
+  if (src_fd < 0) {
+    return nullptr;
+  }
+  struct stat file_stat;
+  if (fstat(src_fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+    close(src_fd);
+    errno = EISDIR;
+    return nullptr;
+  }
+  size_t size = file_stat.st_size;
+  // 以 设备-inode-大小-修改时间 命名，源文件变化后自然不再命中
+  std::string name =
+      std::format("{}-{}-{}-{}", file_stat.st_dev, file_stat.st_ino, size,
+                  file_stat.st_mtim.tv_sec * 1000000000LL +
+                      file_stat.st_mtim.tv_nsec);
+  // mutex 只保护内存中的索引，打开、删除缓存文件等系统调用都在锁外进行
+  bool hit = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+      lru.splice(lru.begin(), lru, it->second.lru);
+      hit = true;
+    }
+  }
+  if (hit) {
+    int fd = openat(cache_fd, name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      // 命中：记录使用时间，重启后据此恢复 LRU 顺序
+      futimens(fd, nullptr);
+      close(src_fd);
+      return std::make_unique<ReadFile>(fd, size);
+    }
+    // 缓存文件已被外部删除或刚被淘汰，按未命中处理
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+      used -= it->second.size;
+      lru.erase(it->second.lru);
+      entries.erase(it);
+    }
+  }
+  // 合并到正在进行的填充，或预留空间后登记新的填充；
+  // 填充队列已满或放不下时直接读容量卷
+  auto cfg = Config::get();
+  std::shared_ptr<Fill> job;
+  bool joined = false;
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto fill_it = fills.find(name);
+    if (fill_it != fills.end()) {
+      job = fill_it->second;
+      joined = true;
+    } else if (!stopping &&
+               pending.size() + opening <
+                   static_cast<size_t>(cfg->cache_fill_queue_size) &&
+               reserve(size, evicted)) {
+      job = std::make_shared<Fill>();
+      job->size = size;
+      fills[name] = job;
+      opening++;
+    }
+  }
+  remove(evicted);
+  if (job == nullptr) {
+    return std::make_unique<ReadFile>(src_fd, size);
+  }
+  if (joined) {
+    // 缓存文件尚未创建时直接读容量卷
+    int fd = job->dup_fd();
+    if (fd < 0) {
+      return std::make_unique<ReadFile>(src_fd, size);
+    }
+    std::cout << "Cache fill joined: " << path << std::endl;
+    close(src_fd);
+    return std::make_unique<FillingFile>(fd, size, std::move(job));
+  }
+  std::string part = name + ".part";
+  int fd = openat(cache_fd, part.c_str(),
+                  O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  int reader_fd = fd < 0 ? -1 : dup(fd);
+  if (reader_fd < 0) {
+    std::cerr << "Failed to create cache file: " << strerror(errno)
+              << std::endl;
+  }
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->fd = fd;
+  }
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    opening--;
+    if (reader_fd >= 0 && !stopping) {
+      // 线程数只增不减
+      while (workers.size() < static_cast<size_t>(cfg->cache_fill_threads)) {
+        workers.emplace_back(&TieredStorage::worker, this);
+      }
+      pending.push_back({job, src_fd, name});
+      queued = true;
+    } else {
+      fills.erase(name);
+      used -= size;
+    }
+  }
+  if (!queued) {
+    if (fd >= 0) {
+      unlinkat(cache_fd, part.c_str(), 0);
+    }
+    if (reader_fd >= 0) {
+      close(reader_fd);
+    }
+    // 已合并进来的读者以失败结束
+    job->publish(0, false, true);
+    return std::make_unique<ReadFile>(src_fd, size);
+  }
+  std::cout << "Cache miss, filling: " << path << std::endl;
+  pending_cv.notify_one();
+  return std::make_unique<FillingFile>(reader_fd, size, std::move(job));
+}
+
+void TieredStorage::fill(std::shared_ptr<Fill> job, int src_fd,
+                         std::string name) {
+  uint64_t offset = 0;
+  Buffer buffer; // 不能在内核中直接复制时使用
+  bool ok = true;
+  while (offset < job->size) {
+    // 停止时放弃未完成的填充
+    if (stopping) {
+      ok = false;
+      break;
+    }
+    size_t count = std::min<uint64_t>(FILL_STEP, job->size - offset);
+    ssize_t n = 0;
+    if (buffer.data() == nullptr) {
+      off_t in = offset;
+      off_t out = offset;
+      n = copy_file_range(src_fd, &in, job->fd, &out, count, 0);
+      if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                    errno == EOPNOTSUPP)) {
+        buffer = BufferPool::acquire(FILL_STEP);
+        continue;
+      }
+    } else {
+      n = pread(src_fd, buffer.data(), count, offset);
+      if (n > 0 && !write_all(job->fd, buffer.data(), n, offset)) {
+        n = -1;
+      }
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // 读写出错或源文件被截断
+      std::cerr << "Cache fill failed for " << name << std::endl;
+      ok = false;
+      break;
+    }
+    offset += n;
+    job->publish(offset, false, false);
+  }
+  close(src_fd);
+  std::string part = name + ".part";
+  if (ok && renameat(cache_fd, part.c_str(), cache_fd, name.c_str()) < 0) {
+    ok = false;
+  }
+  if (!ok) {
+    unlinkat(cache_fd, part.c_str(), 0);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    fills.erase(name);
+    if (ok) {
+      lru.push_front(name);
+      entries[name] = {job->size, lru.begin()};
+    } else {
+      used -= job->size;
+    }
+  }
+  job->publish(offset, ok, !ok);
+}
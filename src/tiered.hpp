@@ -0,0 +1,79 @@
+#pragma once
+#include "storage.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ftp {
+
+// 分层存储：根目录所在的慢速容量卷之前加一层本地 SSD 读缓存
+// 未命中时在后台把文件复制到缓存目录，首个客户端边填充边读取，
+// 同一文件的并发未命中合并为一次填充；填充在固定数量的线程中排队进行，
+// 队列已满时直接读容量卷；缓存按总大小做 LRU 淘汰
+// 上传与目录列表直接访问容量卷
+class TieredStorage : public LocalStorage {
+public:
+  // 打开缓存目录并加载已有的缓存文件，失败返回 nullptr
+  static std::shared_ptr<TieredStorage> create(const std::string &cache_path);
+
+  explicit TieredStorage(int cache_fd) : cache_fd(cache_fd) {}
+  ~TieredStorage() override;
+
+  std::unique_ptr<ReadFile> open_read(const Client &session,
+                                      std::string_view path) override;
+  // 中止正在进行的填充并结束填充线程，排队中的填充以失败告知读者
+  void stop() override;
+
+private:
+  struct Fill;
+  class FillingFile;
+
+  // 缓存中的完整文件
+  struct Entry {
+    uint64_t size;                        // 文件大小
+    std::list<std::string>::iterator lru; // 在 lru 中的位置
+  };
+
+  // 启动时扫描缓存目录，清理未完成的填充
+  void scan();
+  // 淘汰最久未用的文件直到能再放下 size 字节，需持有 mutex
+  // 被淘汰的文件名追加到 evicted，由调用者在锁外删除
+  bool reserve(uint64_t size, std::vector<std::string> &evicted);
+  // 删除被淘汰的缓存文件，不持有 mutex
+  void remove(const std::vector<std::string> &evicted);
+  // 等待填充的文件
+  struct Pending {
+    std::shared_ptr<Fill> job;
+    int src_fd = -1;
+    std::string name;
+  };
+
+  // 在填充线程中把 src_fd 复制到缓存文件
+  void fill(std::shared_ptr<Fill> job, int src_fd, std::string name);
+  // 填充线程，依次处理 pending 中的文件
+  void worker();
+  // 放弃已移出 fills 的填充，删除临时文件并通知读者，不持有 mutex
+  void discard(const Pending &pending);
+
+private:
+  int cache_fd; // 缓存目录
+  std::mutex mutex;
+  std::list<std::string> lru; // 缓存文件名，表头为最近使用
+  std::unordered_map<std::string, Entry> entries;
+  std::unordered_map<std::string, std::shared_ptr<Fill>> fills; // 正在填充
+  uint64_t used = 0; // 已占用（含正在填充）的字节数
+  std::deque<Pending> pending;        // 等待填充的文件
+  size_t opening = 0; // 已预留空间、正在创建缓存文件的填充
+  std::condition_variable pending_cv; // 通知填充线程
+  std::vector<std::thread> workers;   // 已启动的填充线程，受 mutex 保护
+  std::atomic<bool> stopping = false; // 通知填充线程退出
+};
+
+} // namespace ftp
@@ -0,0 +1,183 @@
+#include "tls.hpp"
+#include "config.hpp"
+#include "executor.hpp"
+#include <fcntl.h>
+#include <iostream>
+#include <openssl/err.h>
+#include <sys/epoll.h>
+
+using namespace ftp;
+
+inline std::atomic<std::shared_ptr<SSL_CTX>> Tls::context;
+
+// 输出并清空 OpenSSL 错误队列
+static void print_errors(const char *what) {
+  unsigned long err = ERR_get_error();
+  std::cerr << what << ": "
+            << (err != 0 ? ERR_error_string(err, nullptr) : "unknown error")
+            << std::endl;
+  ERR_clear_error();
+}
+
+bool Tls::reload() {
+  auto cfg = Config::get();
+  if (cfg->tls_cert.empty()) {
+    context.store(nullptr);
+    return true;
+  }
+  std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(TLS_server_method()), SSL_CTX_free);
+  if (ctx == nullptr) {
+    print_errors("Failed to create TLS context");
+    return false;
+  }
+  SSL_CTX_set_min_proto_version(ctx.get(), TLS1_2_VERSION);
+  const std::string &key = cfg->tls_key.empty() ? cfg->tls_cert : cfg->tls_key;
+  if (SSL_CTX_use_certificate_chain_file(ctx.get(), cfg->tls_cert.c_str()) !=
+          1 ||
+      SSL_CTX_use_PrivateKey_file(ctx.get(), key.c_str(), SSL_FILETYPE_PEM) !=
+          1 ||
+      SSL_CTX_check_private_key(ctx.get()) != 1) {
+    // 证书有误时保留旧上下文
+    print_errors("Failed to load TLS certificate");
+    return false;
+  }
+  if (cfg->ktls) {
+    // 握手完成后由 OpenSSL 把密钥交给内核，内核不支持时自动退回用户态
+    SSL_CTX_set_options(ctx.get(), SSL_OP_ENABLE_KTLS);
+  }
+  // 数据连接复用控制连接的会话（会话缓存与会话票据均可）
+  static constexpr unsigned char session_context[] = "ftp-cpp";
+  SSL_CTX_set_session_id_context(ctx.get(), session_context,
+                                 sizeof(session_context) - 1);
+  SSL_CTX_set_session_cache_mode(ctx.get(), SSL_SESS_CACHE_SERVER);
+  context.store(std::move(ctx));
+  std::cout << "TLS certificate loaded from " << cfg->tls_cert << std::endl;
+  return true;
+}
+
+bool Tls::enabled() { return context.load() != nullptr; }
+
+bool Tls::want_io(SSL *ssl, int ret, uint32_t &events) {
+  switch (SSL_get_error(ssl, ret)) {
+  case SSL_ERROR_WANT_READ:
+    events = EPOLLIN;
+    return true;
+  case SSL_ERROR_WANT_WRITE:
+    events = EPOLLOUT;
+    return true;
+  default:
+    // 对端直接断开时错误队列为空，只输出协议层错误
+    if (ERR_peek_error() != 0) {
+      print_errors("TLS error");
+    }
+    return false;
+  }
+}
+
+Task<SSL *> Tls::accept(int fd) {
+  auto ctx = context.load();
+  if (ctx == nullptr) {
+    co_return nullptr;
+  }
+  SSL *ssl = SSL_new(ctx.get());
+  if (ssl == nullptr) {
+    print_errors("Failed to create TLS session");
+    co_return nullptr;
+  }
+  // 握手与后续读写都以非阻塞方式在事件循环上等待
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  SSL_set_fd(ssl, fd);
+  while (true) {
+    int ret = SSL_accept(ssl);
+    if (ret == 1) {
+      break;
+    }
+    uint32_t events = 0;
+    if (!want_io(ssl, ret, events)) {
+      std::cerr << "TLS handshake failed" << std::endl;
+      SSL_free(ssl);
+      co_return nullptr;
+    }
+    if (co_await Executor::IoAwaiter{fd, events} != 0) {
+      SSL_free(ssl);
+      co_return nullptr;
+    }
+  }
+  std::cout << "TLS established: " << SSL_get_version(ssl) << " "
+            << SSL_get_cipher(ssl)
+            << (SSL_session_reused(ssl) ? ", resumed" : "")
+            << (ktls_send(ssl) ? ", kernel TLS" : "") << std::endl;
+  co_return ssl;
+}
+
+Task<ssize_t> Tls::recv(SSL *ssl, char *data, size_t size) {
+  while (true) {
+    int ret = SSL_read(ssl, data, size);
+    if (ret > 0) {
+      co_return ret;
+    }
+    // 对端发送 close_notify，正常结束
+    if (SSL_get_error(ssl, ret) == SSL_ERROR_ZERO_RETURN) {
+      co_return 0;
+    }
+    uint32_t events = 0;
+    if (!want_io(ssl, ret, events)) {
+      co_return -1;
+    }
+    if (co_await Executor::IoAwaiter{SSL_get_fd(ssl), events} != 0) {
+      co_return -1;
+    }
+  }
+}
+
+Task<ssize_t> Tls::send(SSL *ssl, const char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    int ret = SSL_write(ssl, data + total, size - total);
+    if (ret > 0) {
+      total += ret;
+      continue;
+    }
+    uint32_t events = 0;
+    if (!want_io(ssl, ret, events)) {
+      co_return -1;
+    }
+    if (co_await Executor::IoAwaiter{SSL_get_fd(ssl), events} != 0) {
+      co_return -1;
+    }
+  }
+  co_return total;
+}
+
+Task<ssize_t> Tls::sendfile(SSL *ssl, int file_fd, off_t offset,
+                            size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ossl_ssize_t ret =
+        SSL_sendfile(ssl, file_fd, offset + total, size - total, 0);
+    if (ret > 0) {
+      total += ret;
+      continue;
+    }
+    uint32_t events = 0;
+    if (ret == 0 || !want_io(ssl, ret, events)) {
+      co_return -1;
+    }
+    if (co_await Executor::IoAwaiter{SSL_get_fd(ssl), events} != 0) {
+      co_return -1;
+    }
+  }
+  co_return total;
+}
+
+bool Tls::ktls_send(SSL *ssl) { return BIO_get_ktls_send(SSL_get_wbio(ssl)); }
+
+void Tls::close(SSL *ssl) {
+  if (ssl == nullptr) {
+    return;
+  }
+  // 只发送 close_notify，不等待对端回应
+  SSL_shutdown(ssl);
+  ERR_clear_error();
+  SSL_free(ssl);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "task.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <openssl/ssl.h>
+#include <sys/types.h>
+
+namespace ftp {
+
+// 显式 FTPS（RFC 4217）的 TLS 层
+// 握手由 OpenSSL 完成，之后尽量把会话密钥交给内核 TLS，
+// 发送路径仍可使用 sendfile 零拷贝
+class Tls {
+public:
+  // 按配置的证书与私钥重建上下文，未配置证书时关闭 TLS
+  static bool reload();
+  // 是否可以响应 AUTH TLS
+  static bool enabled();
+
+  // 在已连接的套接字上完成服务端握手，失败返回 nullptr
+  // 同一上下文内的会话可被后续连接复用，数据连接无需完整握手
+  static Task<SSL *> accept(int fd);
+  // 非阻塞收发，未就绪时挂起当前协程，连接断开或出错返回 -1
+  // 对端正常关闭（close_notify）时 recv 返回 0
+  static Task<ssize_t> recv(SSL *ssl, char *data, size_t size);
+  static Task<ssize_t> send(SSL *ssl, const char *data, size_t size);
+  // 由内核加密并从文件直接发送，需 ktls_send 为 true
+  static Task<ssize_t> sendfile(SSL *ssl, int file_fd, off_t offset,
+                                size_t size);
+  // 发送方向是否已卸载到内核 TLS
+  static bool ktls_send(SSL *ssl);
+  // 发送 close_notify 并释放会话，不关闭套接字
+  static void close(SSL *ssl);
+
+private:
+  Tls() = default;
+  ~Tls() = default;
+  Tls(const Tls &) = delete;
+  Tls(Tls &&) = delete;
+  Tls &operator=(const Tls &) = delete;
+  Tls &operator=(Tls &&) = delete;
+
+  // 根据 SSL 错误码得到需要等待的事件，不可恢复的错误返回 false
+  static bool want_io(SSL *ssl, int ret, uint32_t &events);
+
+private:
+  // 当前上下文，重载时整体替换，已建立的会话持有旧上下文的引用
+  static std::atomic<std::shared_ptr<SSL_CTX>> context;
+};
+
+} // namespace ftp
@@ -0,0 +1,98 @@
+#include "tuning.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <fcntl.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace ftp;
+
+// 每次发送的上限
+static constexpr size_t MAX_CHUNK = 4 * 1024 * 1024;
+// 两次测量之间至少发送的字节数
+static constexpr size_t MEASURE_STEP = 1024 * 1024;
+// 丢弃页缓存时落后于发送进度的距离，仍在发送队列中的页不会被丢弃
+static constexpr size_t DROP_LAG = 8 * 1024 * 1024;
+
+Tuner::Tuner(int data_fd, int file_fd, size_t file_size, size_t min_chunk)
+    : data_fd(data_fd), file_fd(file_fd), file_size(file_size),
+      min_chunk(min_chunk), chunk(min_chunk) {
+  auto cfg = Config::get();
+  send_buffer_max = static_cast<uint64_t>(cfg->send_buffer_max) << 10;
+  // 凑满报文段再发出，分段读取或 TLS 记录不会产生小包
+  int on = 1;
+  setsockopt(data_fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+  if (file_fd >= 0) {
+    // 加大内核预读窗口，只影响这次打开
+    posix_fadvise(file_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    drop_cache = cfg->drop_cache_size > 0 &&
+                 file_size >= static_cast<uint64_t>(cfg->drop_cache_size)
+                                  << 20;
+  }
+  measure(0);
+}
+
+Tuner::~Tuner() {
+  int off = 0;
+  setsockopt(data_fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+  if (drop_cache && dropped < file_size) {
+    posix_fadvise(file_fd, dropped, 0, POSIX_FADV_DONTNEED);
+  }
+}
+
+void Tuner::advance(size_t offset) {
+  if (offset >= next_measure) {
+    measure(offset);
+  }
+  if (drop_cache && offset >= dropped + 2 * DROP_LAG) {
+    size_t end = offset - DROP_LAG;
+    posix_fadvise(file_fd, dropped, end - dropped, POSIX_FADV_DONTNEED);
+    dropped = end;
+  }
+}
+
+void Tuner::measure(size_t offset) {
+  tcp_info info{};
+  socklen_t length = sizeof(info);
+  if (getsockopt(data_fd, IPPROTO_TCP, TCP_INFO, &info, &length) < 0 ||
+      info.tcpi_rtt == 0) {
+    next_measure = SIZE_MAX;
+    return;
+  }
+  // 刚建立的连接还没有速率样本，按拥塞窗口估算
+  uint64_t rate = length > offsetof(tcp_info, tcpi_delivery_rate)
+                      ? info.tcpi_delivery_rate
+                      : 0;
+  if (rate == 0) {
+    rate = static_cast<uint64_t>(info.tcpi_snd_cwnd) * info.tcpi_snd_mss *
+           1000000 / info.tcpi_rtt;
+  }
+  uint64_t bdp = rate * info.tcpi_rtt / 1000000;
+  // 每次发送约四分之一个 BDP：时延积大时减少系统调用，小时不一次塞满发送队列
+  // 速率受限于本端发送时样本偏低，此时不缩小
+  size_t next = std::clamp<size_t>(std::bit_ceil(bdp / 4 + 1), min_chunk,
+                                   MAX_CHUNK);
+  chunk = info.tcpi_delivery_rate_app_limited ? std::max(chunk, next) : next;
+  // 未发出的数据保持在两次发送以内，减少排队延迟与内存占用
+  // TCP_CORK 留下的不足一个报文段的数据也算作未发出，水位低于报文段时
+  // 套接字要等到 200ms 后强制发出才可写（如回环接口约 64 KiB 的 MSS）
+  int lowat = static_cast<int>(
+      std::max<size_t>(chunk * 2, static_cast<size_t>(info.tcpi_snd_mss) * 2));
+  setsockopt(data_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+  // 显式设置会关闭内核的自动调整，只在当前缓冲区放不下两倍 BDP 时增大
+  // 内核把设置值加倍作为缓冲区大小，读取时得到的是加倍后的值
+  if (send_buffer_max > 0) {
+    int current = 0;
+    socklen_t size = sizeof(current);
+    int wanted = static_cast<int>(std::min(bdp * 2, send_buffer_max));
+    if (getsockopt(data_fd, SOL_SOCKET, SO_SNDBUF, &current, &size) == 0 &&
+        wanted > current) {
+      int value = wanted / 2;
+      setsockopt(data_fd, SOL_SOCKET, SO_SNDBUF, &value, sizeof(value));
+    }
+  }
+  next_measure = offset + std::max(MEASURE_STEP, chunk * 8);
+}
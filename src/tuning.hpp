@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace ftp {
+
+// 一次下载的套接字与页缓存参数
+// 开始时按握手测得的 RTT 设置，之后每发送一段按 TCP_INFO 中的 RTT 与
+// 发送速率重新估算带宽时延积，调整每次发送的字节数、未发送数据的水位
+// 与发送缓冲区；大文件在发送后丢弃已读过的页缓存
+class Tuner {
+public:
+  // file_fd 为 -1 时不设置文件访问提示，min_chunk 为每次发送的下限
+  Tuner(int data_fd, int file_fd, size_t file_size, size_t min_chunk);
+  // 取消 TCP_CORK，立即发出末尾不足一个报文段的数据
+  ~Tuner();
+  Tuner(const Tuner &) = delete;
+  Tuner(Tuner &&) = delete;
+  Tuner &operator=(const Tuner &) = delete;
+  Tuner &operator=(Tuner &&) = delete;
+
+  // 下一次发送的字节数
+  size_t chunk_size() const { return chunk; }
+  // 已发送到 offset，必要时重新测量并丢弃已发送部分的页缓存
+  void advance(size_t offset);
+
+private:
+  // 按 TCP_INFO 估算带宽时延积并调整参数
+  void measure(size_t offset);
+
+private:
+  int data_fd;              // 数据连接
+  int file_fd;              // 被发送的文件
+  size_t file_size;         // 文件大小
+  size_t min_chunk;         // 每次发送的下限
+  size_t chunk;             // 每次发送的字节数
+  size_t next_measure = 0;  // 下次测量时的发送偏移
+  size_t dropped = 0;       // 已丢弃页缓存的范围末尾
+  bool drop_cache = false;  // 发送后是否丢弃页缓存
+  uint64_t send_buffer_max; // 发送缓冲区上限，0 为由内核调整
+};
+
+} // namespace ftp
@@ -0,0 +1,189 @@
+#include "upgrade.hpp"
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ftp;
+
+// 握手报文，用于确认对端是本程序
+static constexpr char HANDOFF_MAGIC[] = "FTPUPGRADE";
+
+static bool fill_addr(const std::string &sock_path, sockaddr_un &addr) {
+  if (sock_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Upgrade socket path too long: " << sock_path << std::endl;
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, sock_path.c_str(), sock_path.size());
+  return true;
+}
+
+// 套接字所在目录须属于本用户且其他用户不可写，路径无法被替换或抢先占用
+static bool private_dir(const std::string &sock_path) {
+  auto slash = sock_path.rfind('/');
+  std::string dir = ".";
+  if (slash != std::string::npos) {
+    dir = slash == 0 ? "/" : sock_path.substr(0, slash);
+  }
+  struct stat dir_stat;
+  if (stat(dir.c_str(), &dir_stat) < 0 || !S_ISDIR(dir_stat.st_mode)) {
+    std::cerr << "Upgrade socket directory " << dir
+              << " is not accessible: " << strerror(errno) << std::endl;
+    return false;
+  }
+  if (dir_stat.st_uid != geteuid() ||
+      (dir_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+    std::cerr << "Upgrade socket directory " << dir
+              << " must be owned by the server user and not writable by "
+                 "others"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// 对端进程是否与本进程属于同一用户
+static bool same_user(int sock) {
+  ucred cred{};
+  socklen_t len = sizeof(cred);
+  if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+    return false;
+  }
+  if (cred.uid != geteuid()) {
+    std::cerr << "Rejected upgrade peer pid " << cred.pid << " uid "
+              << cred.uid << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int Upgrade::receive(const std::string &sock_path) {
+  sockaddr_un addr;
+  if (!fill_addr(sock_path, addr)) {
+    return -1;
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    std::cerr << "Failed to create upgrade socket" << std::endl;
+    return -1;
+  }
+  if (connect(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    std::cerr << "Failed to connect to old process: " << strerror(errno)
+              << std::endl;
+    close(sock);
+    return -1;
+  }
+  if (!same_user(sock)) {
+    close(sock);
+    return -1;
+  }
+  int listen_fd = recv_fd(sock);
+  close(sock);
+  if (listen_fd >= 0) {
+    std::cout << "Listening socket received from old process" << std::endl;
+  }
+  return listen_fd;
+}
+
+bool Upgrade::serve(const std::string &sock_path, int listen_fd,
+                    std::function<void()> on_handoff) {
+  sockaddr_un addr;
+  if (!fill_addr(sock_path, addr) || !private_dir(sock_path)) {
+    return false;
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0) {
+    std::cerr << "Failed to create upgrade socket" << std::endl;
+    return false;
+  }
+  // 旧进程在交接后不会再使用该路径，直接覆盖
+  unlink(sock_path.c_str());
+  // 只允许本用户连接；目录不可写，绑定后再收紧权限不留可利用的窗口
+  if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      chmod(sock_path.c_str(), 0600) < 0 || listen(sock, 1) < 0) {
+    std::cerr << "Failed to listen on upgrade socket: " << strerror(errno)
+              << std::endl;
+    close(sock);
+    return false;
+  }
+  auto handoff_thread = std::thread([sock, listen_fd, on_handoff] {
+    while (true) {
+      int peer = accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+      if (peer < 0) {
+        continue;
+      }
+      // 只把监听套接字交给同一用户的进程，其他连接既不交接也不触发退出
+      if (!same_user(peer)) {
+        close(peer);
+        continue;
+      }
+      bool ok = send_fd(peer, listen_fd);
+      close(peer);
+      if (ok) {
+        std::cout << "Listening socket handed off to new process" << std::endl;
+        // 路径已由新进程接管，只关闭不删除
+        close(sock);
+        on_handoff();
+        return;
+      }
+      std::cerr << "Failed to hand off listening socket" << std::endl;
+    }
+  });
+  handoff_thread.detach();
+  return true;
+}
+
+bool Upgrade::send_fd(int sock, int fd) {
+  char payload[sizeof(HANDOFF_MAGIC)];
+  memcpy(payload, HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC));
+  iovec iov{payload, sizeof(payload)};
+
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+  return sendmsg(sock, &msg, 0) == sizeof(payload);
+}
+
+int Upgrade::recv_fd(int sock) {
+  char payload[sizeof(HANDOFF_MAGIC)];
+  iovec iov{payload, sizeof(payload)};
+
+  char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (n != sizeof(payload) ||
+      memcmp(payload, HANDOFF_MAGIC, sizeof(HANDOFF_MAGIC)) != 0) {
+    std::cerr << "Invalid handoff message" << std::endl;
+    return -1;
+  }
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    std::cerr << "Handoff message carries no descriptor" << std::endl;
+    return -1;
+  }
+  int fd = -1;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <functional>
+#include <string>
+
+namespace ftp {
+
+// 热升级：新旧进程通过 unix 套接字传递监听套接字
+class Upgrade {
+public:
+  // 新进程调用，从旧进程接收监听套接字，失败返回 -1
+  static int receive(const std::string &sock_path);
+  // 旧进程调用，在后台等待新进程连接并交出 listen_fd
+  // 交接完成后调用 on_handoff
+  static bool serve(const std::string &sock_path, int listen_fd,
+                    std::function<void()> on_handoff);
+
+private:
+  Upgrade() = default;
+  ~Upgrade() = default;
+  Upgrade(const Upgrade &) = delete;
+  Upgrade(Upgrade &&) = delete;
+  Upgrade &operator=(const Upgrade &) = delete;
+  Upgrade &operator=(Upgrade &&) = delete;
+
+  static bool send_fd(int sock, int fd);
+  static int recv_fd(int sock);
+};
+
+} // namespace ftp
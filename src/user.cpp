@@ -1,22 +1,336 @@
 #include "user.hpp"
-#include "configs.hpp"
+#include "config.hpp"
+#include <fstream>
+#include <iostream>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <thread>
+
 using namespace ftp;
 
-// 判断用户是否存在
-bool User::handle_user(std::string_view username) {
-  for (const auto &user : USER_INFO) {
-    if (user.first == username) {
-      return true;
+inline std::atomic<std::shared_ptr<const CredentialTable>> User::table =
+    std::make_shared<const CredentialTable>();
+// 最近校验成功的 (帐号, 口令) 与过期时间
+inline std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+    User::verified;
+// 保护 verified 的互斥锁
+inline std::mutex User::verified_mutex;
+// 配置文件中明文口令转换得到的摘要，以 (帐号, 口令) 的缓存键索引
+inline std::unordered_map<std::string, Credential> User::derived;
+// 认证任务队列
+inline std::deque<std::function<void()>> User::jobs;
+// 保护 jobs、workers 与 stopping 的互斥锁
+inline std::mutex User::jobs_mutex;
+inline std::condition_variable User::jobs_cv;
+// 已启动的认证线程
+inline std::vector<std::thread> User::workers;
+// 通知认证线程退出
+inline bool User::stopping = false;
+
+// scrypt 默认参数：N = 2^14, r = 8, p = 1，约占用 16MiB 内存
+static constexpr uint64_t SCRYPT_N = 1 << 14;
+static constexpr uint32_t SCRYPT_R = 8;
+static constexpr uint32_t SCRYPT_P = 1;
+static constexpr size_t SALT_SIZE = 16;
+static constexpr size_t HASH_SIZE = 32;
+
+static std::string to_hex(const std::string &data) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(data.size() * 2);
+  for (unsigned char c : data) {
+    hex += digits[c >> 4];
+    hex += digits[c & 0xf];
+  }
+  return hex;
+}
+
+static bool from_hex(std::string_view hex, std::string &data) {
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  auto value = [](char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
     }
+    return -1;
+  };
+  data.clear();
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    int high = value(hex[i]);
+    int low = value(hex[i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    data += static_cast<char>(high << 4 | low);
   }
-  return false;
+  return true;
+}
+
+static bool scrypt(std::string_view password, const std::string &salt,
+                   uint64_t n, uint32_t r, uint32_t p, std::string &hash) {
+  hash.resize(HASH_SIZE);
+  return EVP_PBE_scrypt(password.data(), password.size(),
+                        (const unsigned char *)salt.data(), salt.size(), n, r,
+                        p, 0, (unsigned char *)hash.data(), hash.size()) == 1;
+}
+
+// 不存在的帐号按此随机摘要校验，参数与新生成的口令相同，
+// 校验耗时与存在的帐号一致，无法据此枚举帐号
+static const Credential &dummy_credential() {
+  static const Credential credential = [] {
+    Credential dummy{SCRYPT_N, SCRYPT_R, SCRYPT_P, std::string(SALT_SIZE, '\0'),
+                     std::string(HASH_SIZE, '\0')};
+    RAND_bytes((unsigned char *)dummy.salt.data(), dummy.salt.size());
+    RAND_bytes((unsigned char *)dummy.hash.data(), dummy.hash.size());
+    return dummy;
+  }();
+  return credential;
+}
+
+// 判断帐号是否存在
+bool User::handle_user(std::string_view username) {
+  auto current = table.load();
+  return current->find(username) != current->end();
 }
 
 // 校验密码
-bool User::handle_pass(std::string_view username, std::string_view password) {
-  auto it = USER_INFO.find(std::string(username));
-  if (it != USER_INFO.end() && it->second == password) {
+User::VerifyAwaiter User::handle_pass(std::string_view username,
+                                      std::string_view password) {
+  return VerifyAwaiter{username, password};
+}
+
+bool User::VerifyAwaiter::await_ready() {
+  // 短时间内校验成功过的口令直接放行，重连风暴不再重复计算慢哈希
+  if (cache_lookup(cache_key(username, password))) {
+    result = COMMON;
     return true;
   }
   return false;
-}
\ No newline at end of file
+}
+
+bool User::VerifyAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  loop = Executor::current();
+  bool accepted = submit([this, handle] {
+    auto current = table.load();
+    auto it = current->find(username);
+    bool found = it != current->end();
+    if (verify(found ? it->second : dummy_credential(), password) && found) {
+      cache_store(cache_key(username, password));
+      result = COMMON;
+    } else {
+      result = SERVER_INNER_ERROR;
+    }
+    Executor::resume_on(loop, handle);
+  });
+  if (!accepted) {
+    result = AUTH_BUSY;
+  }
+  return accepted;
+}
+
+bool User::reload() {
+  auto cfg = Config::get();
+  auto next = std::make_shared<CredentialTable>();
+  if (!cfg->user_file.empty()) {
+    // 帐号文件每行一个帐号：用户名:摘要
+    std::ifstream file(cfg->user_file);
+    if (!file.is_open()) {
+      std::cerr << "Failed to open user file: " << cfg->user_file << std::endl;
+      return false;
+    }
+    std::string line;
+    int line_no = 0;
+    while (std::getline(file, line)) {
+      line_no++;
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      auto pos = line.find(':');
+      Credential credential;
+      if (pos == std::string::npos ||
+          !parse_credential(std::string_view(line).substr(pos + 1),
+                            credential)) {
+        std::cerr << cfg->user_file << ":" << line_no << ": invalid entry"
+                  << std::endl;
+        return false;
+      }
+      (*next)[line.substr(0, pos)] = std::move(credential);
+    }
+  } else {
+    // 只保留本次仍在使用的明文口令的摘要
+    std::unordered_map<std::string, Credential> kept;
+    for (const auto &[username, password] : cfg->user_info) {
+      Credential credential;
+      if (!parse_credential(password, credential)) {
+        // 兼容配置文件中的明文口令，加载时即转换为摘要；
+        // 帐号与口令未变时沿用上次的摘要，重载不再重复计算慢哈希
+        std::string key = cache_key(username, password);
+        auto it = derived.find(key);
+        if (it != derived.end()) {
+          credential = it->second;
+        } else {
+          std::cerr << "Plaintext password for user " << username
+                    << ", use --hash-password to generate a hash"
+                    << std::endl;
+          if (!parse_credential(hash_password(password), credential)) {
+            std::cerr << "Failed to hash password for user " << username
+                      << std::endl;
+            return false;
+          }
+        }
+        kept[std::move(key)] = credential;
+      }
+      (*next)[username] = std::move(credential);
+    }
+    derived.swap(kept);
+  }
+  std::cout << "Loaded " << next->size() << " users" << std::endl;
+  table.store(std::move(next));
+  // 帐号表变化后已缓存的校验结果不再可信
+  std::lock_guard<std::mutex> lock(verified_mutex);
+  verified.clear();
+  return true;
+}
+
+std::string User::hash_password(std::string_view password) {
+  std::string salt(SALT_SIZE, '\0');
+  RAND_bytes((unsigned char *)salt.data(), salt.size());
+  std::string hash;
+  if (!scrypt(password, salt, SCRYPT_N, SCRYPT_R, SCRYPT_P, hash)) {
+    return "";
+  }
+  return "$scrypt$" + std::to_string(SCRYPT_N) + "$" +
+         std::to_string(SCRYPT_R) + "$" + std::to_string(SCRYPT_P) + "$" +
+         to_hex(salt) + "$" + to_hex(hash);
+}
+
+bool User::parse_credential(std::string_view text, Credential &credential) {
+  constexpr std::string_view prefix = "$scrypt$";
+  if (text.substr(0, prefix.size()) != prefix) {
+    return false;
+  }
+  text.remove_prefix(prefix.size());
+  std::string_view fields[5];
+  for (int i = 0; i < 5; i++) {
+    auto pos = text.find('$');
+    if ((pos == std::string_view::npos) != (i == 4)) {
+      return false;
+    }
+    fields[i] = text.substr(0, pos);
+    text.remove_prefix(pos == std::string_view::npos ? text.size() : pos + 1);
+  }
+  try {
+    credential.n = std::stoull(std::string(fields[0]));
+    credential.r = std::stoul(std::string(fields[1]));
+    credential.p = std::stoul(std::string(fields[2]));
+  } catch (const std::exception &) {
+    return false;
+  }
+  return from_hex(fields[3], credential.salt) &&
+         from_hex(fields[4], credential.hash) && !credential.hash.empty();
+}
+
+bool User::verify(const Credential &credential, std::string_view password) {
+  std::string hash;
+  if (!scrypt(password, credential.salt, credential.n, credential.r,
+              credential.p, hash) ||
+      hash.size() != credential.hash.size()) {
+    return false;
+  }
+  return CRYPTO_memcmp(hash.data(), credential.hash.data(), hash.size()) == 0;
+}
+
+std::string User::cache_key(std::string_view username,
+                            std::string_view password) {
+  static const std::string secret = [] {
+    std::string key(32, '\0');
+    RAND_bytes((unsigned char *)key.data(), key.size());
+    return key;
+  }();
+  std::string message;
+  message.append(username).append(1, '\0').append(password);
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int size = 0;
+  HMAC(EVP_sha256(), secret.data(), secret.size(),
+       (const unsigned char *)message.data(), message.size(), digest, &size);
+  return std::string((const char *)digest, size);
+}
+
+bool User::cache_lookup(const std::string &key) {
+  std::lock_guard<std::mutex> lock(verified_mutex);
+  auto it = verified.find(key);
+  if (it == verified.end()) {
+    return false;
+  }
+  if (it->second < std::chrono::steady_clock::now()) {
+    verified.erase(it);
+    return false;
+  }
+  return true;
+}
+
+void User::cache_store(const std::string &key) {
+  auto ttl = std::chrono::seconds(Config::get()->auth_cache_ttl);
+  if (ttl.count() == 0) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(verified_mutex);
+  // 顺带清理过期项，防止缓存无限增长
+  if (verified.size() >= 4096) {
+    std::erase_if(verified,
+                  [&](const auto &item) { return item.second < now; });
+  }
+  verified[key] = now + ttl;
+}
+
+bool User::submit(std::function<void()> job) {
+  auto cfg = Config::get();
+  std::lock_guard<std::mutex> lock(jobs_mutex);
+  if (stopping || jobs.size() >= static_cast<size_t>(cfg->auth_queue_size)) {
+    return false;
+  }
+  // 线程数只增不减
+  while (workers.size() < static_cast<size_t>(cfg->auth_threads)) {
+    workers.emplace_back(&User::worker);
+  }
+  jobs.push_back(std::move(job));
+  jobs_cv.notify_one();
+  return true;
+}
+
+void User::worker() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs_cv.wait(lock, [] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void User::stop() {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    stopping = true;
+  }
+  jobs_cv.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
@@ -1,12 +1,60 @@
 #pragma once
+#include "define.hpp"
+#include "executor.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace ftp {
 
+// 单个帐号的口令摘要，格式为 $scrypt$N$r$p$盐$摘要
+struct Credential {
+  uint64_t n = 0;
+  uint32_t r = 0;
+  uint32_t p = 0;
+  std::string salt;
+  std::string hash;
+};
+
+// 帐号表，加载后不可修改，重载时整体替换
+using CredentialTable =
+    std::unordered_map<std::string, Credential, StringHash, std::equal_to<>>;
+
 class User {
 public:
+  // 校验口令的 awaiter，结果为 COMMON / SERVER_INNER_ERROR / AUTH_BUSY
+  // 慢哈希在认证线程池中计算，完成后回到原事件循环恢复协程
+  struct VerifyAwaiter {
+    std::string_view username;
+    std::string_view password;
+    int result = SERVER_INNER_ERROR;
+    Executor::Loop *loop = nullptr;
+
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> handle);
+    int await_resume() const noexcept { return result; }
+  };
+
   static bool handle_user(std::string_view username);
-  static bool handle_pass(std::string_view username, std::string_view password);
+  static VerifyAwaiter handle_pass(std::string_view username,
+                                   std::string_view password);
+
+  // 从 user_file 或配置文件的 [users] 段重新加载帐号表
+  static bool reload();
+  // 为口令生成带随机盐的摘要字符串
+  static std::string hash_password(std::string_view password);
+  // 执行完已排队的认证任务后结束认证线程
+  static void stop();
 
 private:
   User() = default;
@@ -15,6 +63,38 @@ private:
   User(User &&) = delete;
   User &operator=(const User &) = delete;
   User &operator=(User &&) = delete;
+
+  static bool parse_credential(std::string_view text, Credential &credential);
+  static bool verify(const Credential &credential, std::string_view password);
+  // 缓存键：进程随机密钥下的 HMAC，不在内存中保留明文口令
+  static std::string cache_key(std::string_view username,
+                               std::string_view password);
+  static bool cache_lookup(const std::string &key);
+  static void cache_store(const std::string &key);
+  // 提交到认证线程池，队列已满时返回 false
+  static bool submit(std::function<void()> job);
+  static void worker();
+
+private:
+  // 当前帐号表
+  static std::atomic<std::shared_ptr<const CredentialTable>> table;
+  // 最近校验成功的 (帐号, 口令) 与过期时间
+  static std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+      verified;
+  // 保护 verified 的互斥锁
+  static std::mutex verified_mutex;
+  // 配置文件中明文口令转换得到的摘要，以 (帐号, 口令) 的缓存键索引
+  // 只在 reload 中访问，重载依次执行，无需加锁
+  static std::unordered_map<std::string, Credential> derived;
+  // 认证任务队列
+  static std::deque<std::function<void()>> jobs;
+  // 保护 jobs、workers 与 stopping 的互斥锁
+  static std::mutex jobs_mutex;
+  static std::condition_variable jobs_cv;
+  // 已启动的认证线程
+  static std::vector<std::thread> workers;
+  // 通知认证线程退出
+  static bool stopping;
 };
 
-}; // namespace ftp
\ No newline at end of file
+}; // namespace ftp
@@ -0,0 +1,182 @@
+// 稳态命令处理的堆分配计数测试
+// 在进程内启动一个会话，经 socketpair 发送命令，统计处理期间的 operator new 次数
+#include "config.hpp"
+#include "path.hpp"
+#include "recorder.hpp"
+#include "server.hpp"
+#include "storage.hpp"
+#include "user.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace ftp;
+
+// 进程内所有线程的分配次数
+static std::atomic<size_t> allocations = 0;
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, std::align_val_t align) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t alignment = static_cast<size_t>(align);
+  size = (size + alignment - 1) / alignment * alignment;
+  if (void *p = std::aligned_alloc(alignment, size == 0 ? alignment : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+  return operator new(size, align);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+// 预热轮数，会话中的容器与缓存在此期间达到稳定容量
+static constexpr int WARMUP_ROUNDS = 20;
+// 计数轮数
+static constexpr int MEASURE_ROUNDS = 200;
+
+// 稳态下应当不分配的命令及其应答码
+static const char *const COMMANDS[][2] = {
+    {"PWD", "257"},     {"TYPE I", "200"}, {"SYST", "215"},
+    {"CWD sub", "250"}, {"CDUP", "250"},   {"MODE S", "200"},
+    {"REST 0", "350"},  {"XYZZY", "500"},
+};
+
+static int client_fd = -1;
+
+// 读取一行应答并检查应答码，不使用堆内存
+static bool expect(const char *line, const char *code) {
+  char response[512];
+  size_t received = 0;
+  while (received < 2 || memcmp(response + received - 2, "\r\n", 2) != 0) {
+    ssize_t n = recv(client_fd, response + received,
+                     sizeof(response) - received - 1, 0);
+    if (n <= 0) {
+      return false;
+    }
+    received += n;
+  }
+  response[received] = '\0';
+  if (strncmp(response, code, strlen(code)) != 0) {
+    std::cerr << line << ": unexpected reply " << response;
+    return false;
+  }
+  return true;
+}
+
+// 发送一条命令并检查应答
+static bool command(const char *line, const char *code) {
+  char request[128];
+  int size = snprintf(request, sizeof(request), "%s\r\n", line);
+  if (send(client_fd, request, size, 0) != size) {
+    return false;
+  }
+  return expect(line, code);
+}
+
+// 执行一轮命令，最后以 USER 重新开始登录，PASS 的校验不计入
+static bool round(size_t &counted) {
+  size_t before = allocations.load();
+  for (auto &[line, code] : COMMANDS) {
+    if (!command(line, code)) {
+      return false;
+    }
+  }
+  if (!command("USER root", "331")) {
+    return false;
+  }
+  counted += allocations.load() - before;
+  return command("PASS root", "230");
+}
+
+int main() {
+  char dir[] = "/tmp/alloc_test.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    std::cerr << "Failed to create temporary directory" << std::endl;
+    return 1;
+  }
+  std::string root = std::string(dir) + "/files";
+  std::string config_path = std::string(dir) + "/ftp.conf";
+  mkdir(root.c_str(), 0755);
+  mkdir((root + "/sub").c_str(), 0755);
+  FILE *config = fopen(config_path.c_str(), "w");
+  fprintf(config, "[server]\nroot_path = %s\n[users]\nroot = root\n",
+          root.c_str());
+  fclose(config);
+
+  if (!Config::load(config_path) || !Path::reload() || !Storage::reload()) {
+    return 1;
+  }
+  Recorder::init(Config::get()->recorder_size);
+  User::reload();
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    std::cerr << "Failed to create socket pair" << std::endl;
+    return 1;
+  }
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  client_fd = fds[1];
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(1);
+  FtpServer::serve(address, fds[0]);
+
+  size_t counted = 0;
+  bool ok = expect("greeting", "220") && command("USER root", "331") &&
+            command("PASS root", "230");
+  for (int i = 0; ok && i < WARMUP_ROUNDS; i++) {
+    ok = round(counted);
+  }
+  counted = 0;
+  for (int i = 0; ok && i < MEASURE_ROUNDS; i++) {
+    ok = round(counted);
+  }
+  close(client_fd);
+  FtpServer::stop();
+  User::stop();
+  rmdir((root + "/sub").c_str());
+  rmdir(root.c_str());
+  unlink(config_path.c_str());
+  rmdir(dir);
+  if (!ok) {
+    std::cerr << "FAILED: session ended unexpectedly" << std::endl;
+    return 1;
+  }
+  std::cerr << "allocations during " << MEASURE_ROUNDS << " rounds: "
+            << counted << std::endl;
+  if (counted != 0) {
+    std::cerr << "FAILED: steady-state commands allocated" << std::endl;
+    return 1;
+  }
+  std::cerr << "PASSED" << std::endl;
+  return 0;
+}
@@ -0,0 +1,196 @@
+// 分层存储的读缓存测试
+// 在两个临时目录中分别模拟 SSD 缓存与容量卷，检查命中、未命中后的填充与淘汰
+#include "config.hpp"
+#include "path.hpp"
+#include "storage.hpp"
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+using namespace ftp;
+
+// 测试文件大小，缓存只有 1 MiB，放不下两个
+static constexpr size_t FILE_SIZE = 600 * 1024;
+// 等待后台填充完成的最长时间
+static constexpr int FILL_TIMEOUT_MS = 5000;
+
+static std::string cache_dir;
+
+// 写入内容为 fill 的测试文件
+static bool write_file(const std::string &path, char fill, struct stat &st) {
+  std::string data(FILE_SIZE, fill);
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  return ok && stat(path.c_str(), &st) == 0;
+}
+
+// 查找源文件对应的完整缓存文件，未找到时返回 false
+static bool find_cached(const struct stat &source, struct stat &cached) {
+  std::string prefix = std::to_string(source.st_dev) + "-" +
+                       std::to_string(source.st_ino) + "-";
+  DIR *dir = opendir(cache_dir.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  bool found = false;
+  while (dirent *entry = readdir(dir)) {
+    std::string_view name = entry->d_name;
+    if (name.starts_with(prefix) && !name.ends_with(".part")) {
+      found = stat((cache_dir + "/" + entry->d_name).c_str(), &cached) == 0;
+      break;
+    }
+  }
+  closedir(dir);
+  return found;
+}
+
+// 等待后台填充把文件放入缓存
+static bool wait_cached(const struct stat &source, struct stat &cached) {
+  for (int waited = 0; waited < FILL_TIMEOUT_MS; waited += 10) {
+    if (find_cached(source, cached)) {
+      return true;
+    }
+    usleep(10 * 1000);
+  }
+  return false;
+}
+
+// 读出全部内容并与 fill 比较
+static bool check_content(ReadFile &file, char fill) {
+  if (file.size() != FILE_SIZE) {
+    return false;
+  }
+  std::vector<char> data(FILE_SIZE);
+  size_t total = 0;
+  while (total < FILE_SIZE) {
+    ssize_t n = file.read(data.data() + total, FILE_SIZE - total, total);
+    if (n <= 0) {
+      return false;
+    }
+    total += n;
+  }
+  for (char c : data) {
+    if (c != fill) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 打开的文件是否就是 target
+static bool same_file(const ReadFile &file, const struct stat &target) {
+  struct stat st;
+  return fstat(file.fd(), &st) == 0 && st.st_dev == target.st_dev &&
+         st.st_ino == target.st_ino;
+}
+
+static bool fail(const char *message) {
+  std::cerr << "FAILED: " << message << std::endl;
+  return false;
+}
+
+static bool run(const Client &session, const struct stat &a,
+                const struct stat &b) {
+  auto storage = Storage::get();
+  struct stat cached_a;
+  struct stat cached_b;
+
+  // 未命中：从容量卷填充，读者边填充边读取
+  auto file = storage->open_read(session, "a");
+  if (file == nullptr || same_file(*file, a)) {
+    return fail("miss was not served through the cache");
+  }
+  if (!wait_cached(a, cached_a)) {
+    return fail("miss did not fill the cache");
+  }
+  if (!check_content(*file, 'a')) {
+    return fail("filled content differs from the source");
+  }
+  file.reset();
+
+  // 命中：直接打开缓存中的文件
+  file = storage->open_read(session, "a");
+  if (file == nullptr || !same_file(*file, cached_a)) {
+    return fail("second read did not hit the cache");
+  }
+  if (!check_content(*file, 'a')) {
+    return fail("cached content differs from the source");
+  }
+  file.reset();
+
+  // 淘汰：缓存放不下第二个文件，最久未用的 a 被删除
+  file = storage->open_read(session, "b");
+  if (file == nullptr || !wait_cached(b, cached_b)) {
+    return fail("second miss did not fill the cache");
+  }
+  if (!check_content(*file, 'b')) {
+    return fail("filled content differs from the source");
+  }
+  file.reset();
+  if (find_cached(a, cached_a)) {
+    return fail("least recently used file was not evicted");
+  }
+  file = storage->open_read(session, "b");
+  if (file == nullptr || !same_file(*file, cached_b)) {
+    return fail("filled file did not hit after eviction");
+  }
+  return true;
+}
+
+int main() {
+  char dir[] = "/tmp/tiered_test.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    std::cerr << "Failed to create temporary directory" << std::endl;
+    return 1;
+  }
+  std::string root = std::string(dir) + "/volume";
+  cache_dir = std::string(dir) + "/cache";
+  std::string config_path = std::string(dir) + "/ftp.conf";
+  mkdir(root.c_str(), 0755);
+  FILE *config = fopen(config_path.c_str(), "w");
+  fprintf(config,
+          "[server]\nroot_path = %s\nstorage = tiered\ncache_path = %s\n"
+          "cache_size = 1\ncache_fill_threads = 1\n[users]\nroot = root\n",
+          root.c_str(), cache_dir.c_str());
+  fclose(config);
+
+  struct stat a;
+  struct stat b;
+  if (!write_file(root + "/a", 'a', a) || !write_file(root + "/b", 'b', b) ||
+      !Config::load(config_path) || !Path::reload() || !Storage::reload()) {
+    return 1;
+  }
+  Client session{};
+  session.curr_path = "/";
+  session.cwd = Path::root();
+  bool ok = run(session, a, b);
+  Storage::get()->stop();
+
+  // 清理临时目录
+  for (auto &path : {root, cache_dir}) {
+    if (DIR *entries = opendir(path.c_str())) {
+      while (dirent *entry = readdir(entries)) {
+        if (entry->d_name[0] != '.') {
+          unlink((path + "/" + entry->d_name).c_str());
+        }
+      }
+      closedir(entries);
+    }
+    rmdir(path.c_str());
+  }
+  unlink(config_path.c_str());
+  rmdir(dir);
+  if (!ok) {
+    return 1;
+  }
+  std::cerr << "PASSED" << std::endl;
+  return 0;
+}
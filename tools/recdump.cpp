@@ -0,0 +1,96 @@
+// 飞行记录解码工具
+// 用法：recdump <记录文件> [-s 会话编号] [-m 最短耗时毫秒]
+// 记录文件由 SIGUSR1（写到 recorder_path）或 SITE DUMP 取得
+// 每行一条命令：时间 会话 命令 参数 应答码 字节数，
+// 之后是各阶段相对收到命令的毫秒数、传输速率与错误
+#include "recorder.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace ftp;
+
+static const char *PHASE_NAMES[Recorder::PHASES] = {"pasv", "accept", "first",
+                                                    "last", "reply"};
+
+static void print(const Recorder::Record &record) {
+  time_t seconds = record.start / 1000000000;
+  tm local;
+  localtime_r(&seconds, &local);
+  char when[32];
+  std::strftime(when, sizeof(when), "%F %T", &local);
+  std::string verb(record.verb, strnlen(record.verb, sizeof(record.verb)));
+  std::string arg(record.arg, strnlen(record.arg, sizeof(record.arg)));
+  std::printf("%s.%03d #%-4llu %-4s %-24s %3u %10llu B", when,
+              static_cast<int>(record.start / 1000000 % 1000),
+              static_cast<unsigned long long>(record.session), verb.c_str(),
+              arg.c_str(), record.reply,
+              static_cast<unsigned long long>(record.bytes));
+  for (int i = 0; i < Recorder::PHASES; i++) {
+    if (record.phases[i] != Recorder::NONE) {
+      std::printf("  %s %.3f", PHASE_NAMES[i], record.phases[i] / 1000.0);
+    }
+  }
+  int32_t first = record.phases[Recorder::FIRST_BYTE];
+  int32_t last = record.phases[Recorder::LAST_BYTE];
+  if (first != Recorder::NONE && last != Recorder::NONE && last > first) {
+    std::printf("  %.1f MB/s",
+                record.bytes / static_cast<double>(last - first));
+  }
+  if (record.error != 0) {
+    std::printf("  error %s", strerror(record.error));
+  }
+  std::printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::fprintf(stderr, "Usage: %s <file> [-s session] [-m min_ms]\n",
+                 argv[0]);
+    return 1;
+  }
+  unsigned long long session = 0;
+  double min_ms = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-s") == 0) {
+      session = std::strtoull(argv[i + 1], nullptr, 10);
+    } else if (std::strcmp(argv[i], "-m") == 0) {
+      min_ms = std::strtod(argv[i + 1], nullptr);
+    }
+  }
+  std::ifstream file(argv[1], std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  Recorder::FileHeader header;
+  if (data.size() < sizeof(header)) {
+    std::fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+    return 1;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (std::memcmp(header.magic, Recorder::MAGIC, sizeof(header.magic)) != 0 ||
+      header.record_size != sizeof(Recorder::Record) ||
+      data.size() < sizeof(header) + header.count * sizeof(Recorder::Record)) {
+    std::fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+    return 1;
+  }
+  std::printf("# %llu records, %llu written since start\n",
+              static_cast<unsigned long long>(header.count),
+              static_cast<unsigned long long>(header.written));
+  for (uint64_t i = 0; i < header.count; i++) {
+    Recorder::Record record;
+    std::memcpy(&record,
+                data.data() + sizeof(header) + i * sizeof(Recorder::Record),
+                sizeof(record));
+    int32_t replied = record.phases[Recorder::REPLIED];
+    if ((session != 0 && record.session != session) ||
+        (min_ms > 0 &&
+         (replied == Recorder::NONE || replied < min_ms * 1000))) {
+      continue;
+    }
+    print(record);
+  }
+  return 0;
+}
@@ -1,9 +1,34 @@
 set_project("ftp")
 set_version("1.0.0")
-set_xmakever("2.7.9")
+set_xmakever("2.8.5")
 set_languages("cxx20")
 
 target("ftp")
     set_kind("binary")
     add_includedirs("src")
-    add_files("src/*.cpp")
\ No newline at end of file
+    add_files("src/*.cpp")
+    add_syslinks("ssl", "crypto")
+
+-- 飞行记录解码工具，只依赖 recorder.hpp 中的记录格式
+target("recdump")
+    set_kind("binary")
+    add_includedirs("src")
+    add_files("tools/recdump.cpp")
+
+-- 稳态命令处理的堆分配计数测试，xmake test 运行
+target("alloc_test")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("src")
+    add_files("src/*.cpp|main.cpp", "tests/alloc_test.cpp")
+    add_syslinks("ssl", "crypto")
+    add_tests("default")
+
+-- 分层存储读缓存的命中、填充与淘汰测试，xmake test 运行
+target("tiered_test")
+    set_kind("binary")
+    set_default(false)
+    add_includedirs("src")
+    add_files("src/*.cpp|main.cpp", "tests/tiered_test.cpp")
+    add_syslinks("ssl", "crypto")
+    add_tests("default")